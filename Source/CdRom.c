@@ -0,0 +1,818 @@
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include "CdRom.h"
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+#define CDROM_REG0 (*(volatile uint8_t*)0x1F801800)
+#define CDROM_REG1 (*(volatile uint8_t*)0x1F801801)
+#define CDROM_REG2 (*(volatile uint8_t*)0x1F801802)
+#define CDROM_REG3 (*(volatile uint8_t*)0x1F801803)
+#define I_MASK (*(volatile unsigned int*)0x1F801074)
+
+#define CDROM_STATUS_DATA_READY (1<<6)
+#define CDROM_STATUS_RESPONSE_READY (1<<5)
+#define CDROM_STATUS_BUSY (1<<7)
+#define CDROM_REQUEST_DATA 0x80
+#define CDROM_IRQ_MASK_BIT (1<<2)
+
+// Double speed, whole sector except sync bytes (0x924 bytes),
+// so that sector header can be checked.
+#define CDROM_MODE 0xA0
+// Number of sectors that can be read ahead.
+#define CDROM_RING_SECTORS 4
+// Header (4 bytes) + subheader (8 bytes) before sector data.
+#define CDROM_SECTOR_HEADER_SIZE 12
+#define CDROM_PVD_LBA 16
+#define CDROM_PVD_ROOT_RECORD 156
+#define CDROM_PATH_PREFIX "cdrom:"
+// Asset archive built by Tools/PackData.c ("OSPK").
+#define CDROM_ARCHIVE_MAGIC 0x4B50534F
+#define CDROM_ARCHIVE_NAME_SIZE 24
+
+/* *************************************
+ * 	Structs and enums
+ * *************************************/
+
+enum
+{
+	CDROM_CMD_SETLOC = 0x02,
+	CDROM_CMD_READN = 0x06,
+	CDROM_CMD_PAUSE = 0x09,
+	CDROM_CMD_INIT = 0x0A,
+	CDROM_CMD_SETMODE = 0x0E
+};
+
+enum
+{
+	CDROM_INT_DATA_READY = 1,
+	CDROM_INT_COMPLETE = 2,
+	CDROM_INT_ACKNOWLEDGE = 3,
+	CDROM_INT_ERROR = 5
+};
+
+// ISO9660 directory record offsets.
+enum
+{
+	CDROM_RECORD_LENGTH = 0,
+	CDROM_RECORD_LBA = 2,
+	CDROM_RECORD_SIZE = 10,
+	CDROM_RECORD_NAME_LENGTH = 32,
+	CDROM_RECORD_NAME = 33
+};
+
+typedef struct t_CdRomArchiveEntry
+{
+	char name[CDROM_ARCHIVE_NAME_SIZE];
+	uint32_t sector;
+	uint32_t size;
+}TYPE_CDROM_ARCHIVE_ENTRY;
+
+typedef enum
+{
+	CDROM_STATE_IDLE = 0,
+	CDROM_STATE_READING,
+	CDROM_STATE_PAUSED
+}CDROM_STATE;
+
+/* *************************************
+ * 	Local Prototypes
+ * *************************************/
+
+static void CdRomCommand(uint8_t cmd, uint8_t* params, uint8_t nParams);
+static uint8_t CdRomGetInterrupt(void);
+static void CdRomAckInterrupt(void);
+static uint8_t CdRomWaitInterrupt(void);
+static void CdRomStartReading(void);
+static void CdRomPause(void);
+static uint32_t CdRomGet32(uint8_t* data);
+static bool CdRomFindRecord(char* name, size_t szName, uint32_t* lba, uint32_t* size);
+static bool CdRomFindArchiveEntry(char* path, uint32_t* lba, uint32_t* size);
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+static volatile CDROM_STATE CdRomState;
+// Sectors read ahead from current file
+static uint8_t ring[CDROM_RING_SECTORS][CDROM_SECTOR_SIZE];
+static uint8_t ring_head;
+static uint8_t ring_tail;
+static uint8_t ring_count;
+// Bytes already consumed from sector pointed to by ring_tail
+static size_t tail_offset;
+// Current file
+static char* file_path;
+static uint32_t file_lba;
+static uint32_t file_size;
+static uint32_t file_consumed;
+// Next sector expected from drive and first sector after current file
+static uint32_t next_lba;
+static uint32_t end_lba;
+// Root directory, read from primary volume descriptor
+static uint32_t root_lba;
+static uint32_t root_size;
+// Asset archive index, sorted by name
+static TYPE_CDROM_ARCHIVE_ENTRY* archive_index;
+static uint32_t archive_entries;
+static uint32_t archive_lba;
+// Archive is looked for on first file access, so that no CD-ROM
+// access is done on boot.
+static bool archive_checked;
+// Drive is only taken from BIOS once a file is read, for the same reason.
+static bool cdrom_initialized;
+static void (*sector_callback)(void);
+
+void CdRomInit(void)
+{
+	uint8_t mode = CDROM_MODE;
+
+	if(cdrom_initialized == true)
+	{
+		return;
+	}
+
+	cdrom_initialized = true;
+
+	// CD-ROM interrupts are serviced by CdRomPoll() from now on,
+	// so BIOS must not acknowledge them.
+	I_MASK &= ~CDROM_IRQ_MASK_BIT;
+
+	// BIOS CD-ROM init is skipped on boot, so motor is started here.
+	CdRomCommand(CDROM_CMD_INIT, NULL, 0);
+	CdRomWaitInterrupt();
+	CdRomWaitInterrupt();
+
+	CdRomCommand(CDROM_CMD_SETMODE, &mode, sizeof(uint8_t));
+	CdRomWaitInterrupt();
+
+	CdRomState = CDROM_STATE_IDLE;
+}
+
+void CdRomDeInit(void)
+{
+	if(cdrom_initialized == false)
+	{
+		return;
+	}
+
+	CdRomClose();
+
+	I_MASK |= CDROM_IRQ_MASK_BIT;
+
+	cdrom_initialized = false;
+}
+
+static void CdRomCommand(uint8_t cmd, uint8_t* params, uint8_t nParams)
+{
+	uint8_t i;
+
+	while(CDROM_REG0 & CDROM_STATUS_BUSY);
+
+	CDROM_REG0 = 0;
+
+	for(i = 0; i < nParams; i++)
+	{
+		CDROM_REG2 = params[i];
+	}
+
+	CDROM_REG1 = cmd;
+}
+
+static uint8_t CdRomGetInterrupt(void)
+{
+	CDROM_REG0 = 1;
+
+	return CDROM_REG3 & 0x07;
+}
+
+static void CdRomAckInterrupt(void)
+{
+	// Response FIFO must be emptied before acknowledging.
+	while(CDROM_REG0 & CDROM_STATUS_RESPONSE_READY)
+	{
+		(void)CDROM_REG1;
+	}
+
+	CDROM_REG0 = 1;
+	CDROM_REG3 = 0x07;
+}
+
+static uint8_t CdRomWaitInterrupt(void)
+{
+	uint8_t irq;
+
+	while( (irq = CdRomGetInterrupt()) == 0);
+
+	CdRomAckInterrupt();
+
+	return irq;
+}
+
+static void CdRomStartReading(void)
+{
+	uint32_t lba = next_lba + 150; // 2 seconds lead-in
+	uint8_t loc[3];
+
+	// Minute, second and sector, in BCD format.
+	loc[0] = ((lba / 4500) / 10) << 4 | ((lba / 4500) % 10);
+	loc[1] = (((lba / 75) % 60) / 10) << 4 | (((lba / 75) % 60) % 10);
+	loc[2] = ((lba % 75) / 10) << 4 | ((lba % 75) % 10);
+
+	CdRomCommand(CDROM_CMD_SETLOC, loc, sizeof(loc));
+	CdRomWaitInterrupt();
+
+	CdRomCommand(CDROM_CMD_READN, NULL, 0);
+	CdRomWaitInterrupt();
+
+	CdRomState = CDROM_STATE_READING;
+}
+
+static void CdRomPause(void)
+{
+	uint8_t irq;
+
+	CdRomCommand(CDROM_CMD_PAUSE, NULL, 0);
+
+	do
+	{
+		// Sectors received meanwhile are discarded.
+		irq = CdRomWaitInterrupt();
+	}while( (irq != CDROM_INT_COMPLETE) && (irq != CDROM_INT_ERROR) );
+
+	CdRomState = CDROM_STATE_PAUSED;
+}
+
+/* *******************************************************************
+ *
+ * @name: void CdRomPoll(void)
+ *
+ * @brief:
+ * 	Moves sectors received from drive into read-ahead ring. Drive is
+ * 	paused when ring is full, and resumed once there is room again.
+ *
+ * @remarks:
+ * 	Sector header is checked against expected position, so reading
+ * 	is restarted from there if any sector was missed because this
+ * 	function was not called often enough.
+ *
+ * *******************************************************************/
+
+void CdRomPoll(void)
+{
+	uint8_t header[CDROM_SECTOR_HEADER_SIZE];
+	uint8_t irq;
+	uint32_t lba;
+	uint16_t i;
+	bool stored = false;
+
+	if(CdRomState == CDROM_STATE_PAUSED)
+	{
+		if( (next_lba < end_lba) && (ring_count < CDROM_RING_SECTORS) )
+		{
+			CdRomStartReading();
+		}
+
+		return;
+	}
+	else if(CdRomState != CDROM_STATE_READING)
+	{
+		return;
+	}
+
+	irq = CdRomGetInterrupt();
+
+	if(irq == 0)
+	{
+		return;
+	}
+
+	CdRomAckInterrupt();
+
+	if(irq == CDROM_INT_ERROR)
+	{
+		dprintf("CdRomPoll: read error at sector %d. Retrying...\n", next_lba);
+		CdRomPause();
+		return;
+	}
+	else if(irq != CDROM_INT_DATA_READY)
+	{
+		return;
+	}
+
+	CDROM_REG0 = 0;
+	CDROM_REG3 = CDROM_REQUEST_DATA;
+
+	while( (CDROM_REG0 & CDROM_STATUS_DATA_READY) == 0);
+
+	for(i = 0; i < CDROM_SECTOR_HEADER_SIZE; i++)
+	{
+		header[i] = CDROM_REG2;
+	}
+
+	// Header contains sector position as BCD minute, second and sector.
+	lba =	((header[0] >> 4) * 10 + (header[0] & 0x0F)) * 4500 +
+			((header[1] >> 4) * 10 + (header[1] & 0x0F)) * 75 +
+			((header[2] >> 4) * 10 + (header[2] & 0x0F)) - 150;
+
+	if( (lba == next_lba) && (ring_count < CDROM_RING_SECTORS) )
+	{
+		uint8_t* dst = ring[ring_head];
+
+		for(i = 0; i < CDROM_SECTOR_SIZE; i++)
+		{
+			dst[i] = CDROM_REG2;
+		}
+
+		ring_head = (ring_head + 1) % CDROM_RING_SECTORS;
+		ring_count++;
+		next_lba++;
+		stored = true;
+	}
+
+	// Discard remaining sector data (EDC/ECC).
+	CDROM_REG0 = 0;
+	CDROM_REG3 = 0;
+
+	if( (lba > next_lba) || (next_lba == end_lba) || (ring_count == CDROM_RING_SECTORS) )
+	{
+		// Sector missed, end of file or no room left for next sector.
+		CdRomPause();
+
+		if(next_lba == end_lba)
+		{
+			CdRomState = CDROM_STATE_IDLE;
+		}
+	}
+
+	if( (stored == true) && (sector_callback != NULL) )
+	{
+		sector_callback();
+	}
+}
+
+void CdRomOpenLba(uint32_t lba, uint32_t size)
+{
+	// Every file read starts here, so drive is set up on first access.
+	CdRomInit();
+
+	CdRomClose();
+
+	file_lba = lba;
+	file_size = size;
+	file_consumed = 0;
+	next_lba = lba;
+	end_lba = lba + ((size + CDROM_SECTOR_SIZE - 1) / CDROM_SECTOR_SIZE);
+
+	if(next_lba != end_lba)
+	{
+		CdRomStartReading();
+	}
+}
+
+void CdRomClose(void)
+{
+	if(CdRomState == CDROM_STATE_READING)
+	{
+		CdRomPause();
+	}
+
+	CdRomState = CDROM_STATE_IDLE;
+
+	ring_head = 0;
+	ring_tail = 0;
+	ring_count = 0;
+	tail_offset = 0;
+	file_path = NULL;
+	file_size = 0;
+	file_consumed = 0;
+	next_lba = 0;
+	end_lba = 0;
+}
+
+static uint32_t CdRomGet32(uint8_t* data)
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
+}
+
+/* *******************************************************************
+ *
+ * @name: static bool CdRomFindRecord(char* name, size_t szName,
+ * 										uint32_t* lba, uint32_t* size)
+ *
+ * @brief:
+ * 	Looks for "name" inside directory pointed to by "lba" and "size".
+ * 	On success, they are overwritten with found entry position and
+ * 	size.
+ *
+ * *******************************************************************/
+
+static bool CdRomFindRecord(char* name, size_t szName, uint32_t* lba, uint32_t* size)
+{
+	uint8_t* sector;
+	size_t szSector;
+
+	CdRomOpenLba(*lba, *size);
+
+	while( (file_consumed < file_size) || (ring_count != 0) )
+	{
+		size_t offset = 0;
+
+		while( (sector = CdRomGetSector(&szSector)) == NULL)
+		{
+			CdRomPoll();
+		}
+
+		while( (offset < szSector) && (sector[offset + CDROM_RECORD_LENGTH] != 0) )
+		{
+			uint8_t* record = &sector[offset];
+
+			if( (record[CDROM_RECORD_NAME_LENGTH] == szName)
+						&&
+				(strncmp((char*)&record[CDROM_RECORD_NAME], name, szName) == 0) )
+			{
+				*lba = CdRomGet32(&record[CDROM_RECORD_LBA]);
+				*size = CdRomGet32(&record[CDROM_RECORD_SIZE]);
+
+				CdRomClose();
+
+				return true;
+			}
+
+			offset += record[CDROM_RECORD_LENGTH];
+		}
+
+		CdRomReleaseSector();
+	}
+
+	CdRomClose();
+
+	return false;
+}
+
+/* *******************************************************************
+ *
+ * @name: bool CdRomOpen(char* path)
+ *
+ * @brief:
+ * 	Walks ISO9660 directories in order to find "path", and then
+ * 	starts reading it in the background.
+ *
+ * @remarks:
+ * 	If "path" is already open and no data has been consumed yet
+ * 	(i.e.: it has been prefetched), it keeps reading it.
+ * 	Files stored in asset archive are looked up in its index instead.
+ * 	Archive index is read on first call.
+ *
+ * *******************************************************************/
+
+bool CdRomOpen(char* path)
+{
+	uint32_t lba;
+	uint32_t size;
+	char* name;
+
+	if(path == NULL)
+	{
+		return false;
+	}
+
+	if(CdRomIsOpen(path) == true)
+	{
+		return true;
+	}
+
+	if(archive_checked == false)
+	{
+		archive_checked = true;
+		CdRomOpenArchive(CDROM_ARCHIVE_PATH);
+	}
+
+	if(CdRomFindArchiveEntry(path, &lba, &size) == true)
+	{
+		// No directory records need to be read.
+		CdRomOpenLba(lba, size);
+
+		file_path = path;
+
+		return true;
+	}
+
+	if(root_lba == 0)
+	{
+		uint8_t* pvd;
+		size_t szSector;
+
+		CdRomOpenLba(CDROM_PVD_LBA, CDROM_SECTOR_SIZE);
+
+		while( (pvd = CdRomGetSector(&szSector)) == NULL)
+		{
+			CdRomPoll();
+		}
+
+		root_lba = CdRomGet32(&pvd[CDROM_PVD_ROOT_RECORD + CDROM_RECORD_LBA]);
+		root_size = CdRomGet32(&pvd[CDROM_PVD_ROOT_RECORD + CDROM_RECORD_SIZE]);
+
+		CdRomClose();
+	}
+
+	lba = root_lba;
+	size = root_size;
+
+	name = path;
+
+	if(strncmp(name, CDROM_PATH_PREFIX, strlen(CDROM_PATH_PREFIX)) == 0)
+	{
+		name += strlen(CDROM_PATH_PREFIX);
+	}
+
+	while(*name != '\0')
+	{
+		size_t szName = 0;
+
+		while(*name == '\\')
+		{
+			name++;
+		}
+
+		while( (name[szName] != '\\') && (name[szName] != '\0') )
+		{
+			szName++;
+		}
+
+		if(CdRomFindRecord(name, szName, &lba, &size) == false)
+		{
+			dprintf("CdRomOpen: could not find \"%s\"!\n", path);
+			return false;
+		}
+
+		name += szName;
+	}
+
+	CdRomOpenLba(lba, size);
+
+	file_path = path;
+
+	return true;
+}
+
+/* *******************************************************************
+ *
+ * @name: bool CdRomOpenArchive(char* path)
+ *
+ * @brief:
+ * 	Reads asset archive index (see Tools/PackData.c) into memory
+ * 	pool. From then on, CdRomOpen() looks files up in it, so each
+ * 	file is read with a single seek.
+ *
+ * @remarks:
+ * 	Pool allocations are never freed, so index is read into arena
+ * 	first and only moved into pool once it has been read entirely.
+ *
+ * *******************************************************************/
+
+bool CdRomOpenArchive(char* path)
+{
+	MEMORY_MARK mark = MemoryGetMark();
+	TYPE_CDROM_ARCHIVE_ENTRY* index;
+	uint32_t header[2];
+	size_t szIndex;
+
+	if(CdRomOpen(path) == false)
+	{
+		return false;
+	}
+
+	if(	(CdRomRead(header, sizeof(header)) != sizeof(header))
+					||
+		(header[0] != CDROM_ARCHIVE_MAGIC)	)
+	{
+		dprintf("CdRomOpenArchive: \"%s\" is not a valid archive!\n", path);
+		CdRomClose();
+		return false;
+	}
+
+	// Checked before multiplying, so that size cannot overflow.
+	if( (header[1] == 0) || (header[1] > (MEMORY_POOL_SIZE / sizeof(TYPE_CDROM_ARCHIVE_ENTRY))) )
+	{
+		dprintf("CdRomOpenArchive: invalid number of files (%d)!\n", header[1]);
+		CdRomClose();
+		return false;
+	}
+
+	szIndex = header[1] * sizeof(TYPE_CDROM_ARCHIVE_ENTRY);
+
+	index = MemoryAlloc(szIndex);
+
+	if(	(index == NULL)
+				||
+		(CdRomRead(index, szIndex) != szIndex)	)
+	{
+		dprintf("CdRomOpenArchive: could not read index!\n");
+		MemoryRelease(mark);
+		CdRomClose();
+		return false;
+	}
+
+	archive_index = MemoryPoolAlloc(szIndex);
+
+	if(archive_index == NULL)
+	{
+		dprintf("CdRomOpenArchive: no room for index!\n");
+		MemoryRelease(mark);
+		CdRomClose();
+		return false;
+	}
+
+	memcpy(archive_index, index, szIndex);
+	MemoryRelease(mark);
+
+	archive_entries = header[1];
+	archive_lba = file_lba;
+
+	CdRomClose();
+
+	dprintf("Asset archive: %d files\n", archive_entries);
+
+	return true;
+}
+
+/* *******************************************************************
+ *
+ * @name: static bool CdRomFindArchiveEntry(char* path, uint32_t* lba,
+ * 											uint32_t* size)
+ *
+ * @brief:
+ * 	Binary search of "path" (i.e.: "cdrom:\DATA\FONTS\FONT_2.FNT;1")
+ * 	inside asset archive index.
+ *
+ * *******************************************************************/
+
+static bool CdRomFindArchiveEntry(char* path, uint32_t* lba, uint32_t* size)
+{
+	uint32_t first = 0;
+	uint32_t last = archive_entries;
+	size_t szName = 0;
+
+	if(strncmp(path, CDROM_PATH_PREFIX, strlen(CDROM_PATH_PREFIX)) == 0)
+	{
+		path += strlen(CDROM_PATH_PREFIX);
+	}
+
+	while(*path == '\\')
+	{
+		path++;
+	}
+
+	// Version suffix (";1") is not stored in the index.
+	while( (path[szName] != ';') && (path[szName] != '\0') )
+	{
+		szName++;
+	}
+
+	if(szName >= CDROM_ARCHIVE_NAME_SIZE)
+	{
+		return false;
+	}
+
+	while(first < last)
+	{
+		uint32_t middle = (first + last) >> 1;
+		TYPE_CDROM_ARCHIVE_ENTRY* entry = &archive_index[middle];
+		int result = strncmp(path, entry->name, szName);
+
+		if( (result == 0) && (entry->name[szName] != '\0') )
+		{
+			// "path" is a prefix of entry name, so it goes before it.
+			result = -1;
+		}
+
+		if(result == 0)
+		{
+			*lba = archive_lba + entry->sector;
+			*size = entry->size;
+			return true;
+		}
+		else if(result < 0)
+		{
+			last = middle;
+		}
+		else
+		{
+			first = middle + 1;
+		}
+	}
+
+	return false;
+}
+
+bool CdRomIsOpen(char* path)
+{
+	return ( (file_path != NULL)
+				&&
+			(file_consumed == 0)
+				&&
+			(strcmp(file_path, path) == 0) );
+}
+
+uint32_t CdRomGetFileSize(void)
+{
+	return file_size;
+}
+
+uint8_t* CdRomGetSector(size_t* sz)
+{
+	uint32_t remaining = file_size - file_consumed;
+
+	if( (ring_count == 0) || (tail_offset != 0) )
+	{
+		return NULL;
+	}
+
+	*sz = (remaining < CDROM_SECTOR_SIZE)? remaining : CDROM_SECTOR_SIZE;
+
+	return ring[ring_tail];
+}
+
+void CdRomReleaseSector(void)
+{
+	uint32_t remaining = file_size - file_consumed;
+
+	if(ring_count == 0)
+	{
+		return;
+	}
+
+	file_consumed += (remaining < (CDROM_SECTOR_SIZE - tail_offset))?
+						remaining : (CDROM_SECTOR_SIZE - tail_offset);
+
+	ring_tail = (ring_tail + 1) % CDROM_RING_SECTORS;
+	ring_count--;
+	tail_offset = 0;
+}
+
+size_t CdRomRead(void* dst, size_t n)
+{
+	size_t total = 0;
+
+	while( (n != 0) && (file_consumed < file_size) )
+	{
+		size_t available;
+
+		if(ring_count == 0)
+		{
+			if(CdRomState == CDROM_STATE_IDLE)
+			{
+				dprintf("CdRomRead: drive stopped before end of file!\n");
+				break;
+			}
+
+			CdRomPoll();
+			continue;
+		}
+
+		available = CDROM_SECTOR_SIZE - tail_offset;
+
+		if(available > (file_size - file_consumed))
+		{
+			available = file_size - file_consumed;
+		}
+
+		if(available > n)
+		{
+			available = n;
+		}
+
+		if(dst != NULL)
+		{
+			memcpy(dst, &ring[ring_tail][tail_offset], available);
+			dst = (uint8_t*)dst + available;
+		}
+
+		tail_offset += available;
+		file_consumed += available;
+		total += available;
+		n -= available;
+
+		if( (tail_offset == CDROM_SECTOR_SIZE) || (file_consumed == file_size) )
+		{
+			ring_tail = (ring_tail + 1) % CDROM_RING_SECTORS;
+			ring_count--;
+			tail_offset = 0;
+		}
+
+		// Keep drive busy while data is being copied.
+		CdRomPoll();
+	}
+
+	return total;
+}
+
+void CdRomSetSectorCallback(void (*callback)(void))
+{
+	sector_callback = callback;
+}
@@ -0,0 +1,73 @@
+#ifndef __CDROM_HEADER__
+#define __CDROM_HEADER__
+
+/* **************************************
+ * 	Includes							*
+ * **************************************/
+
+#include "Global_Inc.h"
+#include "System.h"
+
+/* **************************************
+ * 	Defines								*
+ * **************************************/
+
+#define CDROM_SECTOR_SIZE 2048
+#define CDROM_ARCHIVE_PATH "cdrom:\\DATA.PAK;1"
+
+/* **************************************
+ * 	Global Prototypes					*
+ * **************************************/
+
+// Takes CD-ROM controller away from BIOS. Called on first file access,
+// so no CD-ROM access is done until a file is needed. Further calls
+// do nothing.
+void CdRomInit(void);
+
+// Gives CD-ROM controller back to BIOS (i.e.: before running a PSX-EXE),
+// if it was ever taken.
+void CdRomDeInit(void);
+
+// Looks for file (i.e.: "cdrom:\DATA\FONT.FNT;1") and starts reading
+// it in the background. Only one file can be open at a time.
+bool CdRomOpen(char* path);
+
+// Reads asset archive index, so that files inside it are opened
+// without walking ISO9660 directories. Called by CdRomOpen() on
+// first file access.
+bool CdRomOpenArchive(char* path);
+
+// Starts reading "size" bytes in the background from sector "lba".
+void CdRomOpenLba(uint32_t lba, uint32_t size);
+
+// Stops reading current file.
+void CdRomClose(void);
+
+// Returns whether "path" is the file being currently read, and
+// no data has been consumed from it yet.
+bool CdRomIsOpen(char* path);
+
+// Returns size of current file, in bytes.
+uint32_t CdRomGetFileSize(void);
+
+// Services CD-ROM controller. Must be called often while a file is
+// being read (at least once per sector, ~6.6 ms on double speed).
+void CdRomPoll(void);
+
+// Blocking. Copies up to "n" bytes from current file into "dst", and
+// returns number of bytes copied (less than "n" only on end of file).
+// Pass NULL as "dst" to skip data.
+size_t CdRomRead(void* dst, size_t n);
+
+// Non-blocking. Returns next sector already read from current file,
+// or NULL if not ready yet. It must be released with
+// CdRomReleaseSector() once its data is no longer needed.
+// "sz" is filled with valid bytes inside sector.
+uint8_t* CdRomGetSector(size_t* sz);
+void CdRomReleaseSector(void);
+
+// Sets a callback executed from CdRomPoll() each time a new
+// sector is ready.
+void CdRomSetSectorCallback(void (*callback)(void));
+
+#endif // __CDROM_HEADER__
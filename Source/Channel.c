@@ -0,0 +1,281 @@
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include "Channel.h"
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+#define SIO_DATA (*(volatile uint8_t*)0x1F801040)
+#define SIO_STAT (*(volatile unsigned short*)0x1F801044)
+#define SIO_CTRL (*(volatile unsigned short*)0x1F80104A)
+#define SIO_STAT_TX_READY (1<<0)
+#define SIO_CTRL_TX_IRQ_ENABLE (1<<10)
+// Buffer sizes must be powers of two.
+#define CHANNEL_CONTROL_SIZE 0x100
+#define CHANNEL_TTY_SIZE 0x1000
+#define CHANNEL_PROFILE_SIZE 0x800
+#define CHANNEL_BULK_SIZE 0x100
+#define CHANNEL_FLETCHER_MOD 255
+
+/* *************************************
+ * 	Structs and enums
+ * *************************************/
+
+typedef struct t_Channel
+{
+	uint8_t* buffer;
+	uint16_t mask;
+	// Written by producer only.
+	volatile uint16_t head;
+	// Written by ChannelService() only.
+	volatile uint16_t tail;
+	uint8_t sequence;
+	volatile uint32_t drops;
+	uint32_t drops_reported;
+}TYPE_CHANNEL;
+
+/* *************************************
+ * 	Local Prototypes
+ * *************************************/
+
+static bool ChannelStartFrame(void);
+static uint8_t ChannelNextFrameByte(void);
+static uint16_t ChannelUsed(TYPE_CHANNEL* channel);
+static void ChannelReportDrops(void);
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+static uint8_t control_buffer[CHANNEL_CONTROL_SIZE];
+static uint8_t tty_buffer[CHANNEL_TTY_SIZE];
+static uint8_t profile_buffer[CHANNEL_PROFILE_SIZE];
+static uint8_t bulk_buffer[CHANNEL_BULK_SIZE];
+
+static TYPE_CHANNEL channels[CHANNEL_COUNT] =
+{
+	[CHANNEL_CONTROL] = {.buffer = control_buffer, .mask = CHANNEL_CONTROL_SIZE - 1},
+	[CHANNEL_TTY] = {.buffer = tty_buffer, .mask = CHANNEL_TTY_SIZE - 1},
+	[CHANNEL_PROFILE] = {.buffer = profile_buffer, .mask = CHANNEL_PROFILE_SIZE - 1},
+	[CHANNEL_BULK] = {.buffer = bulk_buffer, .mask = CHANNEL_BULK_SIZE - 1}
+};
+
+// Frame being sent. tx_size is 0 when no frame is in progress.
+static TYPE_CHANNEL* tx_channel;
+static uint8_t tx_header[CHANNEL_HEADER_SIZE];
+static uint8_t tx_size;
+static uint8_t tx_index;
+static uint16_t tx_sum1;
+static uint16_t tx_sum2;
+
+void ChannelInit(void)
+{
+	uint8_t i;
+
+	for(i = 0; i < CHANNEL_COUNT; i++)
+	{
+		TYPE_CHANNEL* channel = &channels[i];
+
+		channel->head = 0;
+		channel->tail = 0;
+		channel->sequence = 0;
+		channel->drops = 0;
+		channel->drops_reported = 0;
+	}
+
+	tx_size = 0;
+}
+
+static uint16_t ChannelUsed(TYPE_CHANNEL* channel)
+{
+	return (channel->head - channel->tail) & channel->mask;
+}
+
+/* *******************************************************************
+ *
+ * @name: bool ChannelWrite(CHANNEL_ID ch, const void* data, size_t n)
+ *
+ * @brief:
+ * 	Copies "data" into channel buffer and enables SIO TX interrupt,
+ * 	so it is sent by ChannelService(). Data is either queued as a
+ * 	whole or dropped, so records are never split by a drop.
+ *
+ * @remarks:
+ * 	Producer only writes head and ChannelService() only writes
+ * 	tail, so no locking is needed between them.
+ *
+ * *******************************************************************/
+
+bool ChannelWrite(CHANNEL_ID ch, const void* data, size_t n)
+{
+	TYPE_CHANNEL* channel = &channels[ch];
+	const uint8_t* src = data;
+	uint16_t head = channel->head;
+	size_t i;
+
+	// One byte is kept free to tell a full buffer from an empty one.
+	if(n > (channel->mask - ChannelUsed(channel)))
+	{
+		channel->drops += n;
+		return false;
+	}
+
+	for(i = 0; i < n; i++)
+	{
+		channel->buffer[head] = src[i];
+		head = (head + 1) & channel->mask;
+	}
+
+	channel->head = head;
+
+	SIO_CTRL |= SIO_CTRL_TX_IRQ_ENABLE;
+
+	return true;
+}
+
+void ChannelService(void)
+{
+	while(SIO_STAT & SIO_STAT_TX_READY)
+	{
+		if( (tx_size == 0) && (ChannelStartFrame() == false) )
+		{
+			SIO_CTRL &= ~SIO_CTRL_TX_IRQ_ENABLE;
+			return;
+		}
+
+		SIO_DATA = ChannelNextFrameByte();
+	}
+}
+
+void ChannelFlush(CHANNEL_ID ch)
+{
+	while( (ChannelUsed(&channels[ch]) != 0) || (tx_size != 0) )
+	{
+		ChannelService();
+	}
+}
+
+/* *******************************************************************
+ *
+ * @name: static void ChannelReportDrops(void)
+ *
+ * @brief:
+ * 	Queues a CHANNEL_MSG_DROPS message into control channel for
+ * 	each channel which dropped data since last report.
+ *
+ * *******************************************************************/
+
+static void ChannelReportDrops(void)
+{
+	uint8_t i;
+
+	for(i = 0; i < CHANNEL_COUNT; i++)
+	{
+		TYPE_CHANNEL* channel = &channels[i];
+		uint32_t drops = channel->drops;
+		uint32_t lost = drops - channel->drops_reported;
+		uint8_t msg[] = {	CHANNEL_MSG_DROPS, i,
+							(uint8_t)lost, (uint8_t)(lost >> 8),
+							(uint8_t)(lost >> 16), (uint8_t)(lost >> 24)	};
+
+		if(lost == 0)
+		{
+			continue;
+		}
+
+		if(ChannelWrite(CHANNEL_CONTROL, msg, sizeof(msg)) == true)
+		{
+			channel->drops_reported = drops;
+		}
+	}
+}
+
+/* *******************************************************************
+ *
+ * @name: static bool ChannelStartFrame(void)
+ *
+ * @brief:
+ * 	Prepares a frame from non-empty channel with highest priority.
+ * 	Returns false if all channels are empty.
+ *
+ * *******************************************************************/
+
+static bool ChannelStartFrame(void)
+{
+	uint8_t i;
+
+	ChannelReportDrops();
+
+	for(i = 0; i < CHANNEL_COUNT; i++)
+	{
+		TYPE_CHANNEL* channel = &channels[i];
+		uint16_t used = ChannelUsed(channel);
+
+		if(used != 0)
+		{
+			uint8_t len = (used > CHANNEL_MAX_PAYLOAD)? CHANNEL_MAX_PAYLOAD : used;
+
+			tx_channel = channel;
+			tx_header[0] = CHANNEL_SYNC;
+			tx_header[1] = i;
+			tx_header[2] = channel->sequence++;
+			tx_header[3] = len;
+			tx_size = CHANNEL_HEADER_SIZE + len + CHANNEL_TRAILER_SIZE;
+			tx_index = 0;
+			tx_sum1 = 0;
+			tx_sum2 = 0;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static uint8_t ChannelNextFrameByte(void)
+{
+	uint8_t payload_end = tx_size - CHANNEL_TRAILER_SIZE;
+	uint8_t byte;
+
+	if(tx_index < CHANNEL_HEADER_SIZE)
+	{
+		byte = tx_header[tx_index];
+	}
+	else if(tx_index < payload_end)
+	{
+		byte = tx_channel->buffer[tx_channel->tail];
+		tx_channel->tail = (tx_channel->tail + 1) & tx_channel->mask;
+	}
+	else
+	{
+		byte = (tx_index == payload_end)? (uint8_t)tx_sum1 : (uint8_t)tx_sum2;
+	}
+
+	// Sync byte is left out of checksum.
+	if( (tx_index != 0) && (tx_index < payload_end) )
+	{
+		tx_sum1 += byte;
+
+		if(tx_sum1 >= CHANNEL_FLETCHER_MOD)
+		{
+			tx_sum1 -= CHANNEL_FLETCHER_MOD;
+		}
+
+		tx_sum2 += tx_sum1;
+
+		if(tx_sum2 >= CHANNEL_FLETCHER_MOD)
+		{
+			tx_sum2 -= CHANNEL_FLETCHER_MOD;
+		}
+	}
+
+	if(++tx_index == tx_size)
+	{
+		tx_size = 0;
+	}
+
+	return byte;
+}
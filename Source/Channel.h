@@ -0,0 +1,68 @@
+#ifndef __CHANNEL_HEADER__
+#define __CHANNEL_HEADER__
+
+/* **************************************
+ * 	Includes							*
+ * **************************************/
+
+#include "Global_Inc.h"
+
+/* **************************************
+ * 	Defines								*
+ * **************************************/
+
+// First byte of each frame sent to PC.
+#define CHANNEL_SYNC 0xA5
+// Sync, channel, sequence and payload length.
+#define CHANNEL_HEADER_SIZE 4
+// Fletcher-16 of header (sync excluded) and payload, little-endian.
+#define CHANNEL_TRAILER_SIZE 2
+// Larger payloads are split, so that a frame from a channel with
+// higher priority never waits for more than one frame.
+#define CHANNEL_MAX_PAYLOAD 64
+
+// Control channel message sent when data was dropped from a
+// channel: CHANNEL_MSG_DROPS, channel, dropped bytes (32-bit word).
+#define CHANNEL_MSG_DROPS 'd'
+
+/* **************************************
+ * 	Structs and enums					*
+ * **************************************/
+
+// Lower values are sent first.
+typedef enum
+{
+	CHANNEL_CONTROL = 0,
+	CHANNEL_TTY,
+	// Profiler samples: interrupted PC and $ra (32-bit words).
+	CHANNEL_PROFILE,
+	// Memory, VRAM and trace dumps served by loader on standby.
+	CHANNEL_BULK,
+
+	CHANNEL_COUNT
+}CHANNEL_ID;
+
+/* **************************************
+ * 	Global Prototypes					*
+ * **************************************/
+
+// Empties all channels. To be called before SIO TX interrupt is used.
+void ChannelInit(void);
+
+// Queues "n" bytes into channel "ch". Never blocks: if there is not
+// enough room, nothing is queued, dropped bytes are counted and
+// reported to PC later, and false is returned.
+// Each channel must only be written from a single context.
+bool ChannelWrite(CHANNEL_ID ch, const void* data, size_t n);
+
+// Sends queued frames while SIO is able to accept data. To be called
+// from SIO interrupt. Disables SIO TX interrupt once all channels
+// are empty.
+void ChannelService(void);
+
+// Blocking. Sends frames until channel "ch" is empty. Only to be
+// called with interrupts disabled, or from loader, which sends frames
+// by polling and never enables SIO interrupt.
+void ChannelFlush(CHANNEL_ID ch);
+
+#endif // __CHANNEL_HEADER__
@@ -14,9 +14,7 @@
 
 enum
 {
-	END_ANIMATION_FADEOUT_STEP = 8,
-	
-	END_ANIMATION_LINE_STEP = 2,
+	END_ANIMATION_FADEOUT_MAX = 0xF8,
 	
 	END_ANIMATION_SQUARES_SIZE_BITSHIFT = 5,
 	END_ANIMATION_SQUARES_SIZE = 32,
@@ -40,6 +38,8 @@ enum
 static void EndAnimationSquares(void);
 static void EndAnimationFadeOut(void);
 static void EndAnimationLine(void);
+static void EndAnimationStartTimer(void);
+static uint32_t EndAnimationGetProgress(uint32_t max);
 
 /* *************************************
  * 	Local Variables
@@ -47,10 +47,66 @@ static void EndAnimationLine(void);
 
 static GsRectangle EndAnimationRect;
 static GsSprite EndAnimationDisplay;
+// Animation length, in SystemGetTimestamp() ticks. Not initialized
+// here, since .data is not reloaded when OpenSend is restarted from
+// resident mode: it must be set by EndAnimationSetDuration().
+static uint32_t EndAnimationTicks;
+static uint32_t EndAnimationStart;
+
+/* *******************************************************************
+ *
+ * @name: void EndAnimationSetDuration(uint16_t ms)
+ *
+ * @brief:
+ * 	Sets end animation length in milliseconds, regardless of video
+ * 	mode and of how long each frame takes. If 0, no animation is
+ * 	played and EndAnimation() returns immediately.
+ *
+ * *******************************************************************/
+
+void EndAnimationSetDuration(uint16_t ms)
+{
+	EndAnimationTicks = ((uint32_t)ms * SYSTEM_TIMESTAMP_FREQUENCY) / 1000;
+}
+
+static void EndAnimationStartTimer(void)
+{
+	EndAnimationStart = SystemGetTimestamp();
+}
+
+/* *******************************************************************
+ *
+ * @name: static uint32_t EndAnimationGetProgress(uint32_t max)
+ *
+ * @return:
+ * 	Value between 0 and "max", proportional to time elapsed since
+ * 	EndAnimationStartTimer() was called. "max" is returned once
+ * 	animation duration has elapsed.
+ *
+ * *******************************************************************/
+
+static uint32_t EndAnimationGetProgress(uint32_t max)
+{
+	uint32_t elapsed = SystemGetTimestamp() - EndAnimationStart;
+
+	if(elapsed >= EndAnimationTicks)
+	{
+		return max;
+	}
+
+	return (elapsed * max) / EndAnimationTicks;
+}
 
 void EndAnimation(void)
 {
 	uint8_t randIndex = 0;
+
+	if(EndAnimationTicks == 0)
+	{
+		// Instant exit requested.
+		GfxWaitGPUIdle();
+		return;
+	}
 	
 	GfxSaveDisplayData(&EndAnimationDisplay);
 	
@@ -83,42 +139,70 @@ void EndAnimation(void)
 			break;
 		}
 	}
+
+	// Last frame must be completely drawn before leaving.
+	GfxWaitGPUIdle();
 }
 
+/* *******************************************************************
+ *
+ * @name: void EndAnimationFadeOut(void)
+ *
+ * @brief:
+ * 	Fades display out to black.
+ *
+ * @remarks:
+ * 	Displayed buffer is kept between frames (dirty mode), so each
+ * 	frame only sorts a single subtractive rectangle with the
+ * 	difference between current and previous darkness.
+ *
+ * *******************************************************************/
+
 void EndAnimationFadeOut(void)
 {
-	uint8_t i;
+	uint16_t applied = 0;
+	uint16_t target;
+	
+	GfxSortSprite(&EndAnimationDisplay);
+	GfxDirtyModeEnable();
 	
-	while(1)
+	EndAnimationStartTimer();
+	
+	do
 	{
-		if( GfxGetGlobalLuminance() > 0)
-		{
-			GfxSetGlobalLuminance(GfxGetGlobalLuminance() - END_ANIMATION_FADEOUT_STEP);
-			
-			GfxSortSprite(&EndAnimationDisplay);;
-			GfxDrawScene_Slow();
-		}
-		else
+		// GPU only uses 5 bits per component, so lower 3 bits are
+		// discarded to avoid losing precision between frames.
+		target = EndAnimationGetProgress(END_ANIMATION_FADEOUT_MAX) & ~0x07;
+		
+		if(target > applied)
 		{
-			GsSortCls(0,0,0);
-			
-			for(i = 0 ; i < 2 ; i++)
-			{
-				// Draw two frames to ensure black display
-				GfxDrawScene_Slow();
-			}
-			
-			break;
+			GfxSortFadeRect(target - applied, true);
+			applied = target;
 		}
-	}
+		
+		GfxDrawScene();
+		
+	}while(target < END_ANIMATION_FADEOUT_MAX);
+	
+	// Draw a final frame to ensure black display
+	GfxSortCls(0,0,0);
+	GfxDrawScene();
+	
+	GfxDirtyModeDisable();
 }
 
 void EndAnimationLine(void)
 {
 	short rectIndex = 0;
 	
+	EndAnimationStartTimer();
+	
 	do
 	{
+		// Same end point as frame-based version: last frame is drawn
+		// with rectIndex == X_SCREEN_RESOLUTION / 2.
+		rectIndex = EndAnimationGetProgress(X_SCREEN_RESOLUTION >> 1);
+		
 		GfxSortSprite(&EndAnimationDisplay);
 		
 		// Draw upper half rectangle
@@ -129,7 +213,7 @@ void EndAnimationLine(void)
 		EndAnimationRect.w = X_SCREEN_RESOLUTION;
 		EndAnimationRect.h = rectIndex;
 		
-		GsSortRectangle(&EndAnimationRect);
+		GfxSortRectangle(&EndAnimationRect);
 		
 		EndAnimationRect.x = 0;
 		EndAnimationRect.y = Y_SCREEN_RESOLUTION - rectIndex;
@@ -137,23 +221,33 @@ void EndAnimationLine(void)
 		EndAnimationRect.w = X_SCREEN_RESOLUTION;
 		EndAnimationRect.h = rectIndex;
 		
-		GsSortRectangle(&EndAnimationRect);
-		
-		GfxDrawScene_Slow();
+		GfxSortRectangle(&EndAnimationRect);
 		
-		rectIndex += END_ANIMATION_LINE_STEP;
+		GfxDrawScene();
 		
-	}while(rectIndex <= (X_SCREEN_RESOLUTION >> 1) );
+	}while(rectIndex < (X_SCREEN_RESOLUTION >> 1) );
 	
 }
 
+/* *******************************************************************
+ *
+ * @name: void EndAnimationSquares(void)
+ *
+ * @brief:
+ * 	Covers screen with black squares in random order.
+ *
+ * @remarks:
+ * 	Reveal order is precomputed with a Fisher-Yates shuffle, and
+ * 	displayed buffer is kept between frames (dirty mode), so each
+ * 	frame only sorts squares revealed since previous frame.
+ *
+ * *******************************************************************/
+
 void EndAnimationSquares(void)
 {
-	uint16_t i, j, k;
-	uint16_t randInd = 0;
-	bool sqPos[END_ANIMATION_SQUARES_TOTAL];
-	uint16_t sqCounter = END_ANIMATION_SQUARES_TOTAL;
-	uint16_t maxIndex = END_ANIMATION_SQUARES_TOTAL_MAX_INDEX;
+	uint8_t sqOrder[END_ANIMATION_SQUARES_TOTAL];
+	uint16_t i;
+	uint16_t sqRevealed = 0;
 	
 	EndAnimationRect.w = END_ANIMATION_SQUARES_SIZE;
 	EndAnimationRect.h = END_ANIMATION_SQUARES_SIZE;
@@ -162,72 +256,46 @@ void EndAnimationSquares(void)
 	EndAnimationRect.g = 0;
 	EndAnimationRect.b = 0;
 	
-	memset(sqPos, false , END_ANIMATION_SQUARES_TOTAL);
-	
 	for(i = 0; i < END_ANIMATION_SQUARES_TOTAL ; i++)
 	{
+		sqOrder[i] = i;
+	}
+	
+	for(i = END_ANIMATION_SQUARES_TOTAL_MAX_INDEX; i > 0 ; i--)
+	{
+		uint16_t j = SystemRand(0, i);
+		uint8_t aux = sqOrder[i];
 		
-		do
-		{
-			randInd = SystemRand(0,maxIndex);
-			
-			/*dprintf("randInd = %d\t",randInd);
-			dprintf("sqPos[randInd] = %d\n", sqPos[randInd]);*/
-		
-			if(sqPos[randInd] == false)
-			{
-				sqPos[randInd] = true;
-				sqCounter--;
-				
-				while(sqPos[maxIndex] == true)
-				{
-					// Lower maximum value for rand() so that it's
-					// easier to spot new empty index on next iteration.
-					maxIndex--;
-				}
-				
-				break;
-			}
-			else
-			{
-				if(sqCounter == 0)
-				{
-					break;
-				}
-			}
-						
-		}while(1);
-		
-		GfxSortSprite(&EndAnimationDisplay);
+		sqOrder[i] = sqOrder[j];
+		sqOrder[j] = aux;
+	}
+	
+	// Squares are drawn on top of retained display data.
+	GfxSortSprite(&EndAnimationDisplay);
+	GfxDirtyModeEnable();
+	
+	EndAnimationStartTimer();
+	
+	while(sqRevealed < END_ANIMATION_SQUARES_TOTAL)
+	{
+		// Number of revealed squares depends on elapsed time.
+		uint16_t target = EndAnimationGetProgress(END_ANIMATION_SQUARES_TOTAL);
 		
-		if(sqCounter != 0)
+		for( ; sqRevealed < target ; sqRevealed++)
 		{
-			for(j = 0; j < END_ANIMATION_SQUARES_TOTAL ; j++)
-			{
-				if(sqPos[j] == true)
-				{
-					EndAnimationRect.x = ((j) << END_ANIMATION_SQUARES_SIZE_BITSHIFT) -
-												(short)( (j / END_ANIMATION_SQUARES_PER_ROW) *
-												X_SCREEN_RESOLUTION);
-												
-					EndAnimationRect.y =	(short) (j/ END_ANIMATION_SQUARES_PER_ROW) <<
-												END_ANIMATION_SQUARES_SIZE_BITSHIFT;
-												
-					GsSortRectangle(&EndAnimationRect);
-				}
-			}
-		}
-		else
-		{
-			// Quick fix: draw a full black rectangle instead of multiple squares
-			for(k = 0 ; k < 2 ; k++)
-			{
-				// Draw two frames to ensure black display
-				GsSortCls(0,0,0);
-				GfxDrawScene_Slow();
-			}
+			uint8_t sq = sqOrder[sqRevealed];
+			
+			EndAnimationRect.x = (short)(sq % END_ANIMATION_SQUARES_PER_ROW) <<
+										END_ANIMATION_SQUARES_SIZE_BITSHIFT;
+			
+			EndAnimationRect.y = (short)(sq / END_ANIMATION_SQUARES_PER_ROW) <<
+										END_ANIMATION_SQUARES_SIZE_BITSHIFT;
+			
+			GfxSortRectangle(&EndAnimationRect);
 		}
-
-		GfxDrawScene_Slow();
+		
+		GfxDrawScene();
 	}
+	
+	GfxDirtyModeDisable();
 }
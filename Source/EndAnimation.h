@@ -12,12 +12,18 @@
  * 	Defines								*
  * **************************************/
 
+#define END_ANIMATION_DEFAULT_DURATION_MS 500
+
 /* **************************************
  * 	Global Prototypes					*
  * **************************************/
 
 void EndAnimation(void);
 
+// Animation length in milliseconds. 0 skips animation.
+// Must be called before each EndAnimation().
+void EndAnimationSetDuration(uint16_t ms);
+
 /* **************************************
  * 	Global Variables					*	
  * **************************************/
@@ -9,11 +9,16 @@
  * *************************************/
 
 #define FONT_INTERNAL_TEXT_BUFFER_MAX_SIZE 200
+#define MAX_FONT_LUMINANCE 0xFF
 
 /* *************************************
  * 	Local Prototypes
  * *************************************/
 
+static uint8_t FontClampLuminance(int16_t value);
+static void FontApplyLuminance(TYPE_FONT * ptrFont);
+static void FontInitFromSprite(TYPE_FONT * ptrFont);
+
 /* *************************************
  * 	Local Variables
  * *************************************/
@@ -28,6 +33,60 @@ bool FontLoadImage(char* strPath, TYPE_FONT * ptrFont)
 		return false;
 	}
 	
+	FontInitFromSprite(ptrFont);
+	
+	return true;
+}
+
+/* *************************************************************************
+ *
+ * @name: bool FontLoadEmbedded(TYPE_FONT * ptrFont, const uint8_t* data,
+ * 								size_t sz, size_t szTim)
+ *
+ * @brief:
+ * 	Loads font from a RLE-compressed TIM image linked into the
+ * 	executable (see Tools/BmpToC.c). "sz" is compressed data size
+ * 	and "szTim" is uncompressed TIM size.
+ *
+ * @remarks:
+ * 	Data is decompressed into memory arena, which is released once
+ * 	image has been uploaded to VRAM.
+ *
+ * *************************************************************************/
+
+bool FontLoadEmbedded(TYPE_FONT * ptrFont, const uint8_t* data, size_t sz, size_t szTim)
+{
+	MEMORY_MARK mark = MemoryGetMark();
+	uint8_t* tim = MemoryAlloc(szTim);
+	bool success;
+	
+	if(tim == NULL)
+	{
+		return false;
+	}
+	
+	success = (SystemDecompressRLE(data, sz, tim, szTim) == szTim)
+				&&
+			(GfxSpriteFromTim(tim, &ptrFont->spr) == true);
+	
+	// Do not release buffer while it is still being transferred.
+	GfxWaitGPUIdle();
+	
+	MemoryRelease(mark);
+	
+	if(success == false)
+	{
+		dprintf("Could not load embedded font!\n");
+		return false;
+	}
+	
+	FontInitFromSprite(ptrFont);
+	
+	return true;
+}
+
+static void FontInitFromSprite(TYPE_FONT * ptrFont)
+{
 	ptrFont->spr_w = ptrFont->spr.w;
 	ptrFont->spr_h = ptrFont->spr.h;
 	ptrFont->spr_u = ptrFont->spr.u;
@@ -53,11 +112,11 @@ bool FontLoadImage(char* strPath, TYPE_FONT * ptrFont)
 	
 	ptrFont->flags = FONT_NOFLAGS;
 	
+	ptrFont->lum = NORMAL_LUMINANCE;
+	
 	ptrFont->init_ch = FONT_DEFAULT_INIT_CHAR;
 	
 	dprintf("Sprite CX = %d, sprite CY = %d\n",ptrFont->spr.cx, ptrFont->spr.cy);
-	
-	return true;
 }
 
 void FontSetInitChar(TYPE_FONT * ptrFont, char c)
@@ -85,6 +144,41 @@ void FontSetSize(TYPE_FONT * ptrFont, short size, short bitshift)
 	ptrFont->spr.h = ptrFont->char_h;
 }
 
+// Dims (or brightens) text for this font only.
+// Use GfxSetGlobalLuminance() for the whole scene instead.
+void FontSetLuminance(TYPE_FONT* ptrFont, uint8_t lum)
+{
+	ptrFont->lum = lum;
+}
+
+static uint8_t FontClampLuminance(int16_t value)
+{
+	if(value < 0)
+	{
+		return 0;
+	}
+	else if(value > MAX_FONT_LUMINANCE)
+	{
+		return MAX_FONT_LUMINANCE;
+	}
+
+	return (uint8_t)value;
+}
+
+static void FontApplyLuminance(TYPE_FONT * ptrFont)
+{
+	int16_t offset = (int16_t)ptrFont->lum - NORMAL_LUMINANCE;
+
+	if(offset == 0)
+	{
+		return;
+	}
+
+	ptrFont->spr.r = FontClampLuminance(ptrFont->spr.r + offset);
+	ptrFont->spr.g = FontClampLuminance(ptrFont->spr.g + offset);
+	ptrFont->spr.b = FontClampLuminance(ptrFont->spr.b + offset);
+}
+
 void FontSetSpacing(TYPE_FONT* ptrFont, short spacing)
 {
     ptrFont->char_spacing = spacing;
@@ -177,7 +271,25 @@ void FontPrintText(TYPE_FONT * ptrFont, short x, short y, char* str, ...)
 				dprintf("Sprite CX = %d, sprite CY = %d\n",ptrFont->spr.cx, ptrFont->spr.cy);*/
 				//dprintf("Sprite rgb={%d,%d,%d}\n",ptrFont->spr.r, ptrFont->spr.g, ptrFont->spr.b);
 				
-				GfxSortSprite(&ptrFont->spr);
+				if(ptrFont->lum == NORMAL_LUMINANCE)
+				{
+					GfxSortSprite(&ptrFont->spr);
+				}
+				else
+				{
+					uint8_t aux_r = ptrFont->spr.r;
+					uint8_t aux_g = ptrFont->spr.g;
+					uint8_t aux_b = ptrFont->spr.b;
+
+					FontApplyLuminance(ptrFont);
+					GfxSortSprite(&ptrFont->spr);
+
+					// Blend effect relies on unmodified values
+					ptrFont->spr.r = aux_r;
+					ptrFont->spr.g = aux_g;
+					ptrFont->spr.b = aux_b;
+				}
+
 				x += ptrFont->char_spacing;
 			break;
 		}
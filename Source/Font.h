@@ -27,12 +27,14 @@
  * *************************************/
 
 bool FontLoadImage(char* strPath, TYPE_FONT * ptrFont);
+bool FontLoadEmbedded(TYPE_FONT * ptrFont, const uint8_t* data, size_t sz, size_t szTim);
 void FontSetSize(TYPE_FONT * ptrFont, short size, short bitshift);
 void FontPrintText(TYPE_FONT *ptrFont, short x, short y, char* str, ...);
 void FontSetInitChar(TYPE_FONT * ptrFont, char c);
 void FontSetFlags(TYPE_FONT * ptrFont, FONT_FLAGS flags);
 void FontCyclic(void);
 void FontSetSpacing(TYPE_FONT* ptrFont, short spacing);
+void FontSetLuminance(TYPE_FONT* ptrFont, uint8_t lum);
 
 /* *************************************
  * 	Global variables
@@ -0,0 +1,20 @@
+#ifndef __FONT_DATA_HEADER__
+#define __FONT_DATA_HEADER__
+
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include "Global_Inc.h"
+
+/* *************************************
+ * 	Global variables
+ * *************************************/
+
+// Defined in FontData.c, generated by Tools/BmpToC.c from
+// Sprites/Font_2_4bit.bmp (see Makefile).
+extern const uint8_t FontSmallData[];
+extern const size_t FontSmallDataSize;
+extern const size_t FontSmallDataTimSize;
+
+#endif // __FONT_DATA_HEADER__
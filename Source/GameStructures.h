@@ -33,6 +33,7 @@ typedef struct t_Font
 	uint8_t char_per_row;
 	uint8_t max_ch_wrap;
 	FONT_FLAGS flags;
+	uint8_t lum;
 	short spr_w;
 	short spr_h;
 	short spr_u;
@@ -9,12 +9,40 @@
  * *************************************/
 
 #define PRIMITIVE_LIST_SIZE 0x1000
+// CPU sorts primitives into one list while GPU reads the other one.
+#define PRIMITIVE_LIST_COUNT 2
+// Words kept free at the end of the primitive list so that
+// high priority primitives can always be sorted.
+#define PRIMITIVE_LIST_MARGIN 0x20
 #define DOUBLE_BUFFERING_SWAP_Y	256
 #define UPLOAD_IMAGE_FLAG 1
+#define GFX_TIM_MAGIC 0x10
+#define GFX_TIM_PMODE_MASK 0x07
+#define GFX_TIM_HAS_CLUT (1<<3)
+// TIM data is uploaded to VRAM in chunks of this size.
+#define GFX_TIM_CHUNK_SIZE 2048
 #define MAX_LUMINANCE 0xFF
 #define ROTATE_BIT_SHIFT 12
-#define GPUSTAT (*(unsigned int*)0x1F801814)
-#define D2_CHCR (*(unsigned int*)0x1F8010A8)
+// Same register: reads return GPU status, writes go to GP1 (display
+// control).
+#define GPUSTAT (*(volatile unsigned int*)0x1F801814)
+#define GP1 (*(volatile unsigned int*)0x1F801814)
+#define D2_CHCR (*(volatile unsigned int*)0x1F8010A8)
+#define GP0 (*(volatile unsigned int*)0x1F801810)
+#define D2_MADR (*(volatile unsigned int*)0x1F8010A0)
+#define D2_BCR (*(volatile unsigned int*)0x1F8010A4)
+#define GPUSTAT_READY_TO_SEND_VRAM (1<<27)
+#define GP0_CLEAR_CACHE 0x01000000
+#define GP0_COPY_VRAM_TO_CPU 0xC0000000
+#define GP1_DMA_DIRECTION 0x04000000
+#define GP1_DMA_CPU_TO_GP0 2
+#define GP1_DMA_GPUREAD_TO_CPU 3
+// Sync mode 1 (blocks), from device to RAM, start transfer.
+#define D2_CHCR_VRAM_TO_RAM 0x01000200
+#define D2_CHCR_BUSY (1<<24)
+// GPU FIFO depth, so longest DMA block in sync mode 1.
+#define D2_MAX_BLOCK_WORDS 16
+#define D2_MAX_BLOCKS 0xFFFF
 
 /* *************************************
  * 	Structs and enums
@@ -62,6 +90,32 @@ enum
 	
 };
 
+// Worst-case number of words written into the primitive list by
+// each GsSort*() function (packet header + draw mode + data).
+enum
+{
+	GFX_PRIM_SPRITE_WORDS = 16,
+	GFX_PRIM_RECTANGLE_WORDS = 6,
+	GFX_PRIM_GPOLY4_WORDS = 10,
+	GFX_PRIM_CLS_WORDS = 6
+};
+
+enum
+{
+	GFX_TRANS_MODE_ADD = 1,
+	GFX_TRANS_MODE_SUBTRACT = 2
+};
+
+// TIM CLUT and image data block header.
+typedef struct t_TimBlock
+{
+	uint32_t length;
+	uint16_t x;
+	uint16_t y;
+	uint16_t w;
+	uint16_t h;
+}TYPE_TIM_BLOCK;
+
 enum
 {
 	GFX_SECOND_DISPLAY_X = 384,
@@ -79,7 +133,10 @@ GsSprite PSXButtons;
  * 	Local Prototypes
  * *************************************/
 
-
+static void GfxSwapPrimitiveList(void);
+static bool GfxTimOpen(char* fname, uint8_t* pmode, bool* has_clut);
+static void GfxTimClose(void);
+static bool GfxTimUploadBlock(TYPE_TIM_BLOCK* block);
 
 /* *************************************
  * 	Local Variables
@@ -89,25 +146,56 @@ GsSprite PSXButtons;
 static GsDrawEnv DrawEnv;
 // Display environment
 static GsDispEnv DispEnv;
-// Primitive list (it contains all the graphical data for the GPU)
-static unsigned int prim_list[PRIMITIVE_LIST_SIZE];
-// Tells other modules whether data is being loaded to GPU
-static volatile bool gfx_busy;
-// Dictates (R,G,B) brigthness to all sprites silently
+// Primitive lists (they contain all the graphical data for the GPU)
+static unsigned int prim_list[PRIMITIVE_LIST_COUNT][PRIMITIVE_LIST_SIZE];
+// Index of primitive list where new primitives are sorted into
+static uint8_t prim_list_index;
+// Primitive list usage statistics, updated once per frame.
+static TYPE_PRIM_LIST_STATS prim_list_stats;
+// Primitives dropped since last frame was drawn.
+static uint32_t prim_list_dropped;
+// Priority assigned to primitives sorted from now on. Set by
+// SystemInit(), since .data is not reloaded when OpenSend is
+// restarted from resident mode.
+static GFX_PRIORITY prim_priority;
+// Last fence sent to GPU and last fence known to be finished.
+static volatile GFX_FENCE fence_submitted;
+static volatile GFX_FENCE fence_completed;
+// Called repeatedly while waiting for GPU, so CPU can do useful work.
+static void (*gpu_idle_callback)(void);
+// One-shot callback executed once all submitted fences are finished.
+static void (*gpu_fence_callback)(void);
+// Dictates (R,G,B) brigthness to the whole scene silently. Applied as a
+// single semi-transparent rectangle on top of all other primitives.
 static uint8_t global_lum;
+// Double buffer used to upload TIM data to VRAM.
+static uint16_t tim_chunk[2][GFX_TIM_CHUNK_SIZE >> 1];
+// Full-screen rectangle used for fade effects.
+static GsRectangle FadeRect;
+// When true, buffers are not swapped and only dirty rectangles are
+// redrawn on top of displayed buffer.
+static bool gfx_dirty_mode;
+// Y position of the buffer which keeps static background in dirty mode.
+static short gfx_dirty_cache_y;
 // When true, it draws a rectangle on top of all primitives with
 // information for development purposes.
 static bool GfxDevMenuEnableFlag;
 
 void GfxSwapBuffers(void)
 {
+	if(gfx_dirty_mode == true)
+	{
+		// Displayed buffer is drawn directly.
+		return;
+	}
+
 	// Consistency check
 #if PSXSDK_DEBUG
 
-	if(GsListPos() >= PRIMITIVE_LIST_SIZE)
+	if(prim_list_stats.dropped_last_frame != 0)
 	{
-		dprintf("Linked list iterator overflow!\n");
-		while(1);
+		dprintf("Primitive list full! %d primitives dropped.\n",
+				prim_list_stats.dropped_last_frame);
 	}
 	
 	if( (DrawEnv.h != Y_SCREEN_RESOLUTION)
@@ -148,6 +236,112 @@ void GfxSwapBuffers(void)
 	}
 }
 
+/* *******************************************************************
+ *
+ * @name: void GfxDirtyModeEnable(void)
+ *
+ * @brief:
+ * 	Draws primitives sorted so far (i.e.: static background) into
+ * 	back buffer, which is kept from then on as a background cache,
+ * 	and copies it to displayed buffer. Buffers are not swapped
+ * 	anymore: new primitives are drawn directly on displayed buffer,
+ * 	so only areas marked with GfxDirtyRect() need to be redrawn.
+ *
+ * @remarks:
+ * 	Can be called from ISR. It waits for GPU, so only a few
+ * 	primitives should be sorted before calling it.
+ *
+ * *******************************************************************/
+
+void GfxDirtyModeEnable(void)
+{
+	if(gfx_dirty_mode == true)
+	{
+		return;
+	}
+
+	GsDrawList();
+	fence_submitted++;
+	TRACE_BEGIN(TRACE_EVENT_GPU_LIST, fence_submitted);
+	GfxSwapPrimitiveList();
+
+	while(GfxIsGPUBusy() == true);
+
+	gfx_dirty_cache_y = DrawEnv.y;
+
+	MoveImage(	DrawEnv.x,
+				gfx_dirty_cache_y,
+				DispEnv.x,
+				DispEnv.y,
+				X_SCREEN_RESOLUTION,
+				Y_SCREEN_RESOLUTION	);
+
+	DrawEnv.y = DispEnv.y;
+	GsSetDrawEnv(&DrawEnv);
+
+	gfx_dirty_mode = true;
+}
+
+/* *******************************************************************
+ *
+ * @name: void GfxDirtyModeDisable(void)
+ *
+ * @brief:
+ * 	Goes back to normal double buffering. Displayed buffer is copied
+ * 	into background cache first, so no frame without dirty
+ * 	rectangles is shown when buffers are swapped again.
+ *
+ * *******************************************************************/
+
+void GfxDirtyModeDisable(void)
+{
+	if(gfx_dirty_mode == false)
+	{
+		return;
+	}
+
+	GfxWaitGPUIdle();
+
+	MoveImage(	DispEnv.x,
+				DispEnv.y,
+				DrawEnv.x,
+				gfx_dirty_cache_y,
+				X_SCREEN_RESOLUTION,
+				Y_SCREEN_RESOLUTION	);
+
+	GfxWaitGPUIdle();
+
+	gfx_dirty_mode = false;
+}
+
+/* *******************************************************************
+ *
+ * @name: void GfxDirtyRect(short x, short y, short w, short h)
+ *
+ * @brief:
+ * 	Restores static background on given screen area using a
+ * 	VRAM-to-VRAM copy, so new content can be sorted on top of it.
+ *
+ * @remarks:
+ * 	Only has effect in dirty mode. GPU must not be busy.
+ *
+ * *******************************************************************/
+
+void GfxDirtyRect(short x, short y, short w, short h)
+{
+	if(gfx_dirty_mode == false)
+	{
+		return;
+	}
+
+	MoveImage(	x,
+				gfx_dirty_cache_y + y,
+				x,
+				DispEnv.y + y,
+				w,
+				h	);
+}
+
 void GfxDevMenuEnable(void)
 {
     GfxDevMenuEnableFlag = true;
@@ -174,14 +368,170 @@ void GfxInitDispEnv(void)
 
 void GfxSetPrimitiveList(void)
 {
-	GsSetList(prim_list);
+	GsSetList(prim_list[prim_list_index]);
+}
+
+/* *******************************************************************
+ *
+ * @name: static void GfxSwapPrimitiveList(void)
+ *
+ * @brief:
+ * 	Called right after GsDrawList(). While GPU DMA channel walks
+ * 	the list that has just been sent, new primitives are sorted
+ * 	into the other one.
+ *
+ * @remarks:
+ * 	Lists must not be swapped again until DMA transfer is finished,
+ * 	so GfxDrawScene() waits for GfxIsGPUBusy() before drawing.
+ *
+ * *******************************************************************/
+
+static void GfxSwapPrimitiveList(void)
+{
+	prim_list_index ^= 1;
+	GfxSetPrimitiveList();
+}
+
+/* *******************************************************************
+ *
+ * @name: static bool GfxPrimitiveListHasRoom(uint32_t words)
+ *
+ * @brief:
+ * 	Tells whether a primitive taking up to "words" words can be
+ * 	sorted with current priority. Lower priority primitives are
+ * 	rejected earlier, so that there is always room left for higher
+ * 	priority ones. Rejected primitives are counted as dropped.
+ *
+ * *******************************************************************/
+
+static bool GfxPrimitiveListHasRoom(uint32_t words)
+{
+	uint32_t limit = PRIMITIVE_LIST_SIZE - PRIMITIVE_LIST_MARGIN;
+
+	switch(prim_priority)
+	{
+		case GFX_PRIORITY_LOW:
+			limit -= (PRIMITIVE_LIST_SIZE >> 2);
+		break;
+
+		case GFX_PRIORITY_NORMAL:
+			limit -= (PRIMITIVE_LIST_SIZE >> 3);
+		break;
+
+		case GFX_PRIORITY_HIGH:
+			// Fall through
+		default:
+		break;
+	}
+
+	if( (GsListPos() + words) > limit)
+	{
+		prim_list_dropped++;
+		return false;
+	}
+
+	return true;
+}
+
+static void GfxUpdatePrimitiveListStats(void)
+{
+	uint32_t usage = GsListPos();
+
+	prim_list_stats.last_usage = usage;
+
+	if(usage > prim_list_stats.high_water_mark)
+	{
+		prim_list_stats.high_water_mark = usage;
+	}
+
+	prim_list_stats.dropped_last_frame = prim_list_dropped;
+
+	if(prim_list_dropped != 0)
+	{
+		prim_list_stats.dropped_total += prim_list_dropped;
+		prim_list_stats.frames_with_drops++;
+		prim_list_dropped = 0;
+	}
+}
+
+void GfxGetPrimitiveListStats(TYPE_PRIM_LIST_STATS* stats)
+{
+	*stats = prim_list_stats;
+	stats->list_size = PRIMITIVE_LIST_SIZE;
+}
+
+void GfxSetPrimitivePriority(GFX_PRIORITY priority)
+{
+	prim_priority = priority;
+}
+
+/* *******************************************************************
+ *
+ * @name: void GfxSortFadeRect(uint8_t amount, bool darken)
+ *
+ * @brief:
+ * 	Sorts a full-screen semi-transparent rectangle which subtracts
+ * 	(or adds, if "darken" is false) "amount" to R, G and B components
+ * 	of every pixel already drawn.
+ *
+ * @remarks:
+ * 	GPU works with 5-bit components, so only multiples of 8 have
+ * 	any effect.
+ *
+ * *******************************************************************/
+
+void GfxSortFadeRect(uint8_t amount, bool darken)
+{
+	GFX_PRIORITY priority = prim_priority;
+
+	if(amount == 0)
+	{
+		return;
+	}
+
+	FadeRect.x = 0;
+	FadeRect.y = 0;
+	FadeRect.w = X_SCREEN_RESOLUTION;
+	FadeRect.h = Y_SCREEN_RESOLUTION;
+	FadeRect.r = amount;
+	FadeRect.g = amount;
+	FadeRect.b = amount;
+	FadeRect.attribute = ENABLE_TRANS |
+						TRANS_MODE(darken? GFX_TRANS_MODE_SUBTRACT : GFX_TRANS_MODE_ADD);
+
+	// Fade must always be applied, even if other primitives are dropped.
+	prim_priority = GFX_PRIORITY_HIGH;
+	GfxSortRectangle(&FadeRect);
+	prim_priority = priority;
+}
+
+static void GfxSortGlobalLuminance(void)
+{
+	if(global_lum < NORMAL_LUMINANCE)
+	{
+		// 0 -> 255 (black), NORMAL_LUMINANCE -> 0 (no change)
+		GfxSortFadeRect(((NORMAL_LUMINANCE - global_lum) << 1) - 1, true);
+	}
+	else if(global_lum > NORMAL_LUMINANCE)
+	{
+		GfxSortFadeRect((global_lum - NORMAL_LUMINANCE) << 1, false);
+	}
 }
 
 void GfxDrawScene_Fast(void)
 {	
+	TRACE_BEGIN(TRACE_EVENT_GFX_DRAW, GsListPos());
+
+	GfxSortGlobalLuminance();
+	GfxUpdatePrimitiveListStats();
 	GfxSwapBuffers();
 	FontCyclic();
 	GsDrawList();
+	fence_submitted++;
+	TRACE_BEGIN(TRACE_EVENT_GPU_LIST, fence_submitted);
+	GfxSwapPrimitiveList();
+
+	TRACE_END(TRACE_EVENT_GFX_DRAW, 0);
 }
 
 bool GfxReadyForDMATransfer(void)
@@ -191,9 +541,17 @@ bool GfxReadyForDMATransfer(void)
 
 void GfxDrawScene(void)
 {
+	// Previous primitive list must have been walked by GPU
+	// before swapping display and drawing environments.
 	while(	(SystemRefreshNeeded() == false) 
 				||
-			(GfxIsGPUBusy() == true)		);
+			(GfxIsGPUBusy() == true)		)
+	{
+		if(gpu_idle_callback != NULL)
+		{
+			gpu_idle_callback();
+		}
+	}
 			
 	GfxDrawScene_Fast();
 	
@@ -203,14 +561,11 @@ void GfxDrawScene(void)
 void GfxDrawScene_Slow(void)
 {
 	GfxDrawScene();
-	while(GfxIsGPUBusy() == true);
+	GfxWaitGPUIdle();
 }
 
 void GfxSortSprite(GsSprite * spr)
 {
-	uint8_t aux_r = spr->r;
-	uint8_t aux_g = spr->g;
-	uint8_t aux_b = spr->b;
 	unsigned char aux_tpage = spr->tpage;
 	short aux_w = spr->w;
 	short aux_x = spr->x;
@@ -225,37 +580,14 @@ void GfxSortSprite(GsSprite * spr)
 	{
 		return;
 	}
-	
-	if(global_lum != NORMAL_LUMINANCE)
+
+	if(GfxPrimitiveListHasRoom(	(spr->w > MAX_SIZE_FOR_GSSPRITE)?
+								GFX_PRIM_SPRITE_WORDS << 1:
+								GFX_PRIM_SPRITE_WORDS	) == false)
 	{
-		if(spr->r < NORMAL_LUMINANCE - global_lum)
-		{
-			spr->r = 0;
-		}
-		else
-		{
-			spr->r -= NORMAL_LUMINANCE - global_lum;
-		}
-		
-		if(spr->g < NORMAL_LUMINANCE - global_lum)
-		{
-			spr->g = 0;
-		}
-		else
-		{
-			spr->g -= NORMAL_LUMINANCE - global_lum;
-		}
-		
-		if(spr->b < NORMAL_LUMINANCE - global_lum)
-		{
-			spr->b = 0;
-		}
-		else
-		{
-			spr->b -= NORMAL_LUMINANCE - global_lum;
-		}
+		return;
 	}
-
+	
 	if(spr->w > MAX_SIZE_FOR_GSSPRITE)
 	{
 		// GsSprites can't be bigger than 256x256, so since display
@@ -278,10 +610,30 @@ void GfxSortSprite(GsSprite * spr)
 	{
 		GsSortSprite(spr);
 	}
-	
-	spr->r = aux_r;
-	spr->g = aux_g;
-	spr->b = aux_b;
+}
+
+void GfxSortRectangle(GsRectangle * rect)
+{
+	if(GfxPrimitiveListHasRoom(GFX_PRIM_RECTANGLE_WORDS) == true)
+	{
+		GsSortRectangle(rect);
+	}
+}
+
+void GfxSortGPoly4(GsGPoly4 * poly)
+{
+	if(GfxPrimitiveListHasRoom(GFX_PRIM_GPOLY4_WORDS) == true)
+	{
+		GsSortGPoly4(poly);
+	}
+}
+
+void GfxSortCls(uint8_t r, uint8_t g, uint8_t b)
+{
+	if(GfxPrimitiveListHasRoom(GFX_PRIM_CLS_WORDS) == true)
+	{
+		GsSortCls(r, g, b);
+	}
 }
 
 uint8_t GfxGetGlobalLuminance(void)
@@ -315,26 +667,280 @@ int GfxRotateFromDegrees(int deg)
 
 bool GfxIsGPUBusy(void)
 {
-	return (GsIsDrawing() || gfx_busy || (GfxReadyForDMATransfer() == false) );
+	return (GsIsDrawing() || (GfxReadyForDMATransfer() == false) );
+}
+
+/* *******************************************************************
+ *
+ * @name: GFX_FENCE GfxGetFence(void)
+ *
+ * @brief:
+ * 	Returns a fence for all GPU work submitted so far. It can be
+ * 	checked later with GfxIsFenceReached() or GfxWaitFence().
+ *
+ * *******************************************************************/
+
+GFX_FENCE GfxGetFence(void)
+{
+	return fence_submitted;
+}
+
+/* *******************************************************************
+ *
+ * @name: bool GfxIsFenceReached(GFX_FENCE fence)
+ *
+ * @brief:
+ * 	Non-blocking. Tells whether GPU has finished all work submitted
+ * 	up to "fence".
+ *
+ * @remarks:
+ * 	GsIsDrawing() is cleared by PSXSDK from GPU DMA (channel 2)
+ * 	completion interrupt, so no GPU register polling loop is needed
+ * 	in order to know when a primitive list has been walked.
+ *
+ * *******************************************************************/
+
+bool GfxIsFenceReached(GFX_FENCE fence)
+{
+	if( (GfxIsGPUBusy() == false) && (fence_completed != fence_submitted) )
+	{
+		fence_completed = fence_submitted;
+		TRACE_END(TRACE_EVENT_GPU_LIST, fence_completed);
+	}
+
+	// Signed difference keeps working after counter overflow.
+	return ((int32_t)(fence_completed - fence) >= 0);
+}
+
+void GfxWaitFence(GFX_FENCE fence)
+{
+	while(GfxIsFenceReached(fence) == false)
+	{
+		if(gpu_idle_callback != NULL)
+		{
+			gpu_idle_callback();
+		}
+	}
+}
+
+// Blocking. Returns once GPU has finished all submitted work.
+void GfxWaitGPUIdle(void)
+{
+	while(GfxIsGPUBusy() == true)
+	{
+		if(gpu_idle_callback != NULL)
+		{
+			gpu_idle_callback();
+		}
+	}
+
+	if(fence_completed != fence_submitted)
+	{
+		fence_completed = fence_submitted;
+		TRACE_END(TRACE_EVENT_GPU_LIST, fence_completed);
+	}
+}
+
+void GfxSetIdleCallback(void (*callback)(void))
+{
+	gpu_idle_callback = callback;
+}
+
+void GfxSetFenceCallback(void (*callback)(void))
+{
+	gpu_fence_callback = callback;
+}
+
+/* *******************************************************************
+ *
+ * @name: void GfxFenceHandler(void)
+ *
+ * @brief:
+ * 	Executes fence callback, if any, once GPU has finished all
+ * 	submitted work. Callback is removed after being called.
+ *
+ * @remarks:
+ * 	Called from VBlank ISR, so callbacks must be short.
+ *
+ * *******************************************************************/
+
+void GfxFenceHandler(void)
+{
+	void (*callback)(void) = gpu_fence_callback;
+
+	if( (callback != NULL) && (GfxIsFenceReached(fence_submitted) == true) )
+	{
+		gpu_fence_callback = NULL;
+		callback();
+	}
+}
+
+/* *******************************************************************
+ *
+ * @name: static bool GfxTimOpen(char* fname, uint8_t* pmode, bool* has_clut)
+ *
+ * @brief:
+ * 	Opens a TIM file from CD-ROM and reads its header.
+ *
+ * *******************************************************************/
+
+static bool GfxTimOpen(char* fname, uint8_t* pmode, bool* has_clut)
+{
+	uint32_t header[2];
+
+	// Wait for possible previous operation before entering this section.
+	while(SystemIsBusy() == true);
+
+	GfxWaitGPUIdle();
+
+	if(CdRomOpen(fname) == false)
+	{
+		dprintf("Could not open TIM file \"%s\"!\n", fname);
+		return false;
+	}
+
+	if(	(CdRomRead(header, sizeof(header)) != sizeof(header))
+					||
+		(header[0] != GFX_TIM_MAGIC)	)
+	{
+		dprintf("\"%s\" is not a valid TIM file!\n", fname);
+		CdRomClose();
+		return false;
+	}
+
+	*pmode = header[1] & GFX_TIM_PMODE_MASK;
+	*has_clut = (header[1] & GFX_TIM_HAS_CLUT)? true : false;
+
+	SystemSetBusyFlag(true);
+
+	return true;
+}
+
+static void GfxTimClose(void)
+{
+	SystemSetBusyFlag(false);
+
+	SystemPrefetchNextFile();
+}
+
+/* *******************************************************************
+ *
+ * @name: static bool GfxTimUploadBlock(TYPE_TIM_BLOCK* block)
+ *
+ * @brief:
+ * 	Reads a TIM data block (CLUT or image) from current file and
+ * 	uploads it to VRAM in chunks of GFX_TIM_CHUNK_SIZE bytes.
+ * 	"block" is filled with block position and size in VRAM.
+ *
+ * @remarks:
+ * 	Two chunk buffers are used, so next chunk is read from CD-ROM
+ * 	while GPU DMA is uploading previous one. Whole image is never
+ * 	kept in RAM.
+ *
+ * *******************************************************************/
+
+static bool GfxTimUploadBlock(TYPE_TIM_BLOCK* block)
+{
+	uint16_t rows_per_chunk;
+	uint16_t row;
+	uint8_t index = 0;
+
+	if(CdRomRead(block, sizeof(TYPE_TIM_BLOCK)) != sizeof(TYPE_TIM_BLOCK))
+	{
+		return false;
+	}
+
+	// Corrupt or truncated TIM files are rejected before dividing.
+	if(	(block->w == 0) || (block->w > VRAM_W)
+			||
+		(block->h == 0) || (block->h > VRAM_H)	)
+	{
+		return false;
+	}
+
+	// Width is expressed in 16-bit units.
+	rows_per_chunk = GFX_TIM_CHUNK_SIZE / (block->w << 1);
+
+	if(rows_per_chunk == 0)
+	{
+		return false;
+	}
+
+	for(row = 0; row < block->h; row += rows_per_chunk)
+	{
+		uint16_t rows = block->h - row;
+		size_t size;
+
+		if(rows > rows_per_chunk)
+		{
+			rows = rows_per_chunk;
+		}
+
+		size = (rows * block->w) << 1;
+
+		if(CdRomRead(tim_chunk[index], size) != size)
+		{
+			return false;
+		}
+
+		// Previous upload from this buffer is finished for sure.
+		GfxWaitGPUIdle();
+
+		LoadImage(tim_chunk[index], block->x, block->y + row, block->w, rows);
+
+		index ^= 1;
+	}
+
+	return true;
 }
 
 bool GfxSpriteFromFile(char* fname, GsSprite * spr)
 {
-	GsImage gsi;
-	
-	if(SystemLoadFile(fname) == false)
+	TYPE_TIM_BLOCK clut = {0};
+	TYPE_TIM_BLOCK image;
+	uint8_t pmode;
+	bool has_clut;
+	uint8_t shift;
+
+	if(GfxTimOpen(fname, &pmode, &has_clut) == false)
 	{
 		return false;
 	}
-	
-	while(GfxIsGPUBusy() == true);
-	
-	gfx_busy = true;
-		
-	GsImageFromTim(&gsi,SystemGetBufferAddress() );
-	
-	GsSpriteFromImage(spr,&gsi,UPLOAD_IMAGE_FLAG);
-	gfx_busy = false;
+
+	if(	( (has_clut == true) && (GfxTimUploadBlock(&clut) == false) )
+							||
+		(GfxTimUploadBlock(&image) == false)	)
+	{
+		dprintf("Could not upload TIM file \"%s\"!\n", fname);
+		CdRomClose();
+		GfxTimClose();
+		return false;
+	}
+
+	GfxTimClose();
+
+	// Pixels per 16-bit VRAM unit: 4 (4bpp), 2 (8bpp) or 1 (16bpp).
+	shift = (pmode < COLORMODE_16BPP)? (COLORMODE_16BPP - pmode) : 0;
+
+	spr->x = 0;
+	spr->y = 0;
+	spr->tpage = image.x / GFX_TPAGE_WIDTH;
+	spr->tpage += (short)(VRAM_W / GFX_TPAGE_WIDTH) * (short)(image.y / GFX_TPAGE_HEIGHT);
+	spr->u = (image.x % GFX_TPAGE_WIDTH) << shift;
+	spr->v = image.y % GFX_TPAGE_HEIGHT;
+	spr->w = image.w << shift;
+	spr->h = image.h;
+	spr->cx = clut.x;
+	spr->cy = clut.y;
+	spr->attribute = COLORMODE(pmode);
+	spr->r = NORMAL_LUMINANCE;
+	spr->g = NORMAL_LUMINANCE;
+	spr->b = NORMAL_LUMINANCE;
+	spr->mx = 0;
+	spr->my = 0;
+	spr->scalex = 0;
+	spr->scaley = 0;
+	spr->rotate = 0;
 
     DEBUG_PRINT_VAR(spr->tpage);
     DEBUG_PRINT_VAR(spr->u);
@@ -345,28 +951,57 @@ bool GfxSpriteFromFile(char* fname, GsSprite * spr)
 	return true;
 }
 
-bool GfxCLUTFromFile(char* fname)
+/* *******************************************************************
+ *
+ * @name: bool GfxSpriteFromTim(uint8_t* tim, GsSprite * spr)
+ *
+ * @brief:
+ * 	Uploads a TIM image already stored in RAM to VRAM.
+ *
+ * @remarks:
+ * 	Upload is asynchronous, so "tim" must not be modified until
+ * 	GfxWaitGPUIdle() returns.
+ *
+ * *******************************************************************/
+
+bool GfxSpriteFromTim(uint8_t* tim, GsSprite * spr)
 {
 	GsImage gsi;
 
-	if(SystemLoadFile(fname) == false)
+	GfxWaitGPUIdle();
+
+	if(GsImageFromTim(&gsi, tim) == 0)
 	{
+		dprintf("Invalid TIM image!\n");
 		return false;
 	}
-	
-	while(GfxIsGPUBusy() == true);
-	
-	gfx_busy = true;
-		
-	GsImageFromTim(&gsi,SystemGetBufferAddress() );
-	
-	GsUploadCLUT(&gsi);
-	
-	gfx_busy = false;
-	
+
+	GsSpriteFromImage(spr, &gsi, UPLOAD_IMAGE_FLAG);
+
 	return true;
 }
 
+bool GfxCLUTFromFile(char* fname)
+{
+	TYPE_TIM_BLOCK clut;
+	uint8_t pmode;
+	bool has_clut;
+	bool success;
+
+	if(GfxTimOpen(fname, &pmode, &has_clut) == false)
+	{
+		return false;
+	}
+
+	// Image data is discarded, so file is closed right after CLUT.
+	success = (has_clut == true) && (GfxTimUploadBlock(&clut) == true);
+
+	CdRomClose();
+	GfxTimClose();
+	
+	return success;
+}
+
 bool GfxIsInsideScreenArea(short x, short y, short w, short h)
 {
 	if( ( (x + w) >= 0) 
@@ -400,13 +1035,15 @@ void GfxButtonRemoveFlags(uint8_t flags)
 
 void GfxDrawButton(short x, short y, unsigned short btn)
 {
-	static bool first_entered = true;
+	// In BSS, so it is cleared again with orig_u and orig_v when
+	// OpenSend is restarted from resident mode.
+	static bool orig_saved;
 	static short orig_u;
 	static short orig_v;
 	
-	if(first_entered == true)
+	if(orig_saved == false)
 	{
-		first_entered = false;
+		orig_saved = true;
 		orig_u = PSXButtons.u;
 		orig_v = PSXButtons.v;
 	}
@@ -500,9 +1137,93 @@ void GfxDrawButton(short x, short y, unsigned short btn)
 	PSXButtons.rotate = 0;
 }
 
+/* *******************************************************************
+ *
+ * @name: bool GfxStoreImage(uint16_t* dst, short x, short y, short w, short h)
+ *
+ * @brief:
+ * 	Starts copying a VRAM rectangle into RAM ("dst", word-aligned)
+ * 	using GPU to CPU DMA. GfxWaitStoreImage() must be called before
+ * 	using data or sending any other command to the GPU, so CPU can
+ * 	do other work (i.e.: sending previous rectangle) meanwhile.
+ *
+ * @remarks:
+ * 	"w" must be an even number. System busy flag is kept set until
+ * 	GfxWaitStoreImage() returns, so ISRs do not draw meanwhile.
+ *
+ * *******************************************************************/
+
+bool GfxStoreImage(uint16_t* dst, short x, short y, short w, short h)
+{
+	uint32_t words;
+	uint32_t block_words = D2_MAX_BLOCK_WORDS;
+
+	if(	(x < 0) || (y < 0) || (w <= 0) || (h <= 0) || (w & 1)
+					||
+		((x + w) > VRAM_W) || ((y + h) > VRAM_H)	)
+	{
+		return false;
+	}
+
+	// Two pixels per word. Blocks must add up to exactly this, or
+	// DMA would write past "dst".
+	words = ((uint32_t)w * h) >> 1;
+
+	while(words % block_words)
+	{
+		block_words >>= 1;
+	}
+
+	if((words / block_words) > D2_MAX_BLOCKS)
+	{
+		return false;
+	}
+
+	GfxWaitGPUIdle();
+
+	SystemSetBusyFlag(true);
+
+	GP0 = GP0_CLEAR_CACHE;
+	GP0 = GP0_COPY_VRAM_TO_CPU;
+	GP0 = (y << 16) | x;
+	GP0 = (h << 16) | w;
+
+	while(!(GPUSTAT & GPUSTAT_READY_TO_SEND_VRAM));
+
+	GP1 = GP1_DMA_DIRECTION | GP1_DMA_GPUREAD_TO_CPU;
+
+	D2_MADR = (unsigned int)dst;
+	D2_BCR = ((words / block_words) << 16) | block_words;
+	D2_CHCR = D2_CHCR_VRAM_TO_RAM;
+
+	return true;
+}
+
+void GfxWaitStoreImage(void)
+{
+	while(D2_CHCR & D2_CHCR_BUSY)
+	{
+		if(gpu_idle_callback != NULL)
+		{
+			gpu_idle_callback();
+		}
+	}
+
+	// PSXSDK expects DMA direction to be set for primitive lists.
+	GP1 = GP1_DMA_DIRECTION | GP1_DMA_CPU_TO_GP0;
+
+	SystemSetBusyFlag(false);
+}
+
+void GfxGetDisplayPosition(short* x, short* y)
+{
+	*x = DispEnv.x;
+	*y = DispEnv.y;
+}
+
 void GfxSaveDisplayData(GsSprite *spr)
 {
-	while(GfxIsGPUBusy() == true);
+	GfxWaitGPUIdle();
 	
 	MoveImage(	DispEnv.x,
 				DispEnv.y,
@@ -523,7 +1244,7 @@ void GfxSaveDisplayData(GsSprite *spr)
 	spr->g = NORMAL_LUMINANCE;
 	spr->b = NORMAL_LUMINANCE;
 
-	while(GfxIsGPUBusy() == true);
+	GfxWaitGPUIdle();
 }
 
 bool GfxTPageOffsetFromVRAMPosition(GsSprite * spr, short x, short y)
@@ -25,6 +25,33 @@
 #define GFX_2HZ_FLASH			(1<<8)
 #define FULL_LUMINANCE			0xFF
 
+/* *************************************
+ * 	Structs and enums
+ * *************************************/
+
+// Primitives with lower priority are dropped first
+// when the primitive list is running out of space.
+typedef enum t_gfxpriority
+{
+	GFX_PRIORITY_LOW = 0,
+	GFX_PRIORITY_NORMAL,
+	GFX_PRIORITY_HIGH
+}GFX_PRIORITY;
+
+// Identifies GPU work submitted up to a given moment.
+typedef uint32_t GFX_FENCE;
+
+// All sizes are expressed in 32-bit words.
+typedef struct t_PrimListStats
+{
+	uint32_t list_size;
+	uint32_t last_usage;
+	uint32_t high_water_mark;
+	uint32_t dropped_last_frame;
+	uint32_t dropped_total;
+	uint32_t frames_with_drops;
+}TYPE_PRIM_LIST_STATS;
+
 /* *************************************
  * 	Global prototypes
  * *************************************/
@@ -34,10 +61,12 @@ void GfxInitDispEnv(void);
 void GfxSetPrimitiveList(void);
 
 // Renders new scene. Use this function unless you know what you are doing!
+// It returns as soon as GPU starts drawing, so primitives for next frame
+// can be sorted in the meantime.
 void GfxDrawScene(void);
 
 // Blocking version. Calls GfxDrawScene() and then adds a while(GfxIsBusy() )
-// after it.
+// after it. Only needed when GPU must be idle afterwards (e.g.: VRAM access).
 void GfxDrawScene_Slow(void);
 
 void GfxDrawScene_NoSwap(void);
@@ -54,6 +83,9 @@ bool GfxReadyForDMATransfer(void);
 // Fills a GsSprite structure with information from a TIM file.
 bool GfxSpriteFromFile(char* fname, GsSprite * spr);
 
+// Uploads a TIM image stored in RAM to VRAM.
+bool GfxSpriteFromTim(uint8_t* tim, GsSprite * spr);
+
 // Reportedly, loads CLUT data from a TIM image (image data is discarded)
 bool GfxCLUTFromFile(char* fname);
 
@@ -66,10 +98,41 @@ bool GfxIsSpriteInsideScreenArea(GsSprite * spr);
 // Used to know whether GPU operation can be done.
 bool GfxIsGPUBusy(void);
 
+// Fence API. Waiting functions execute idle callback, if any,
+// while GPU is busy instead of just burning CPU cycles.
+GFX_FENCE GfxGetFence(void);
+bool GfxIsFenceReached(GFX_FENCE fence);
+void GfxWaitFence(GFX_FENCE fence);
+void GfxWaitGPUIdle(void);
+void GfxSetIdleCallback(void (*callback)(void));
+
+// Sets a one-shot callback executed from VBlank ISR
+// once GPU has finished all submitted work.
+void GfxSetFenceCallback(void (*callback)(void));
+void GfxFenceHandler(void);
+
 // Draws a sprite on screen. First, it checks whether sprite is inside
 // screen limits.
 void GfxSortSprite(GsSprite * spr);
 
+// Overloads for other primitive types. Primitives are silently
+// dropped if the primitive list has no room left for them.
+void GfxSortRectangle(GsRectangle * rect);
+void GfxSortGPoly4(GsGPoly4 * poly);
+void GfxSortCls(uint8_t r, uint8_t g, uint8_t b);
+
+// Sets priority for primitives sorted from now on.
+void GfxSetPrimitivePriority(GFX_PRIORITY priority);
+
+// Fills "stats" with primitive list usage from last drawn frame
+// and its high-water mark since startup.
+void GfxGetPrimitiveListStats(TYPE_PRIM_LIST_STATS* stats);
+
+// Sorts a full-screen rectangle that darkens (or brightens) everything
+// sorted before it by "amount". Global luminance relies on it, so it
+// costs a single primitive regardless of how many sprites are drawn.
+void GfxSortFadeRect(uint8_t amount, bool darken);
+
 uint8_t GfxGetGlobalLuminance(void);
 
 void GfxSetGlobalLuminance(uint8_t value);
@@ -88,6 +151,15 @@ void GfxDrawButton(short x, short y, unsigned short btn);
 // sprite structure pointed to by "spr".
 void GfxSaveDisplayData(GsSprite *spr);
 
+// Starts copying a VRAM rectangle into RAM. Asynchronous.
+bool GfxStoreImage(uint16_t* dst, short x, short y, short w, short h);
+
+// Waits until GfxStoreImage() has finished.
+void GfxWaitStoreImage(void);
+
+// Returns VRAM position of the displayed framebuffer.
+void GfxGetDisplayPosition(short* x, short* y);
+
 // Fills GsSprite structure pointed to by "spr" with texture page and U/V
 // offset data given a position in VRAM.
 bool GfxTPageOffsetFromVRAMPosition(GsSprite * spr, short x, short y);
@@ -100,6 +172,12 @@ void GfxDrawScene_NoSwap(void);
 
 void GfxDevMenuEnable(void);
 
+// Dirty rectangle mode. Static background is drawn once, and then
+// only areas marked as dirty are restored and redrawn each frame.
+void GfxDirtyModeEnable(void);
+void GfxDirtyModeDisable(void);
+void GfxDirtyRect(short x, short y, short w, short h);
+
 /* *************************************
  * 	Global variables
  * *************************************/
@@ -0,0 +1,135 @@
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include "IrqStats.h"
+#include "System.h"
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+#define RCNT1_COUNT (*(volatile unsigned int*)0x1F801110)
+// Horizontal blanks per frame, non-interlaced video modes.
+#ifdef _PAL_MODE_
+#define IRQ_STATS_LINES_PER_FRAME 314
+#else
+#define IRQ_STATS_LINES_PER_FRAME 263
+#endif // _PAL_MODE_
+
+/* *************************************
+ * 	Local Prototypes
+ * *************************************/
+
+static void IrqStatsAdd(volatile uint32_t* histogram, uint32_t ticks);
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+static volatile TYPE_IRQ_STATS irq_stats;
+// Root counter 1 values (horizontal blanks).
+static uint16_t vblank_enter_time;
+static uint16_t mask_begin_time;
+static bool vblank_entered;
+// VBlank ISR entry time relative to first entry, minus whole frames.
+static int32_t vblank_offset;
+static int32_t vblank_min_offset;
+
+static void IrqStatsAdd(volatile uint32_t* histogram, uint32_t ticks)
+{
+	uint8_t bucket = 0;
+
+	while( (ticks != 0) && (bucket < (IRQ_STATS_BUCKETS - 1)) )
+	{
+		ticks >>= 1;
+		bucket++;
+	}
+
+	histogram[bucket]++;
+}
+
+/* *******************************************************************
+ *
+ * @name: void IrqStatsVBlankEnter(void)
+ *
+ * @brief:
+ * 	VBlank IRQ is raised once per frame, every
+ * 	IRQ_STATS_LINES_PER_FRAME horizontal blanks. Entry time is
+ * 	tracked relative to that period, so any delay over the fastest
+ * 	entry seen so far (which only includes BIOS and PSXSDK dispatch
+ * 	code) is interrupt latency.
+ *
+ * @remarks:
+ * 	Resolution is one horizontal blank (~64 us). Baseline is only
+ * 	reliable once an undisturbed VBlank has been serviced.
+ *
+ * *******************************************************************/
+
+void IrqStatsVBlankEnter(void)
+{
+	uint16_t now = (uint16_t)RCNT1_COUNT;
+
+	if(vblank_entered == true)
+	{
+		uint16_t elapsed = now - vblank_enter_time;
+		// Whole frames elapsed, rounded to nearest.
+		uint16_t frames = (elapsed + (IRQ_STATS_LINES_PER_FRAME >> 1)) / IRQ_STATS_LINES_PER_FRAME;
+
+		if(frames > 1)
+		{
+			irq_stats.vblank_missed += frames - 1;
+		}
+
+		vblank_offset += (int32_t)elapsed - (int32_t)(frames * IRQ_STATS_LINES_PER_FRAME);
+
+		if(vblank_offset < vblank_min_offset)
+		{
+			vblank_min_offset = vblank_offset;
+		}
+
+		IrqStatsAdd(irq_stats.vblank_latency, vblank_offset - vblank_min_offset);
+	}
+
+	vblank_entered = true;
+	vblank_enter_time = now;
+}
+
+void IrqStatsVBlankExit(void)
+{
+	IrqStatsAdd(irq_stats.isr_duration, (uint16_t)((uint16_t)RCNT1_COUNT - vblank_enter_time));
+}
+
+void IrqStatsMaskBegin(void)
+{
+	mask_begin_time = (uint16_t)RCNT1_COUNT;
+}
+
+void IrqStatsMaskEnd(bool vblank_pending, void* caller)
+{
+	uint16_t duration = (uint16_t)RCNT1_COUNT - mask_begin_time;
+
+	IrqStatsAdd(irq_stats.vblank_masked, duration);
+
+	if(vblank_pending == true)
+	{
+		irq_stats.vblank_delayed++;
+	}
+
+	if(duration > irq_stats.worst_masked)
+	{
+		irq_stats.worst_masked = duration;
+		irq_stats.worst_masked_caller = (uint32_t)caller;
+	}
+}
+
+void IrqStatsCountSioOverrun(void)
+{
+	irq_stats.sio_overruns++;
+}
+
+void IrqStatsGet(TYPE_IRQ_STATS* stats)
+{
+	memcpy(stats, (void*)&irq_stats, sizeof(TYPE_IRQ_STATS));
+	stats->frequency = SYSTEM_TIMESTAMP_FREQUENCY;
+}
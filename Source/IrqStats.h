@@ -0,0 +1,62 @@
+#ifndef __IRQ_STATS_HEADER__
+#define __IRQ_STATS_HEADER__
+
+/* **************************************
+ * 	Includes							*
+ * **************************************/
+
+#include "Global_Inc.h"
+
+/* **************************************
+ * 	Defines								*
+ * **************************************/
+
+// Bucket n counts durations between 2^(n-1) and (2^n) - 1 ticks
+// (bucket 0: less than 1 tick). Last bucket also counts longer ones.
+#define IRQ_STATS_BUCKETS 16
+
+/* **************************************
+ * 	Structs and enums					*
+ * **************************************/
+
+// All durations are in SYSTEM_TIMESTAMP_FREQUENCY ticks.
+typedef struct t_IrqStats
+{
+	uint32_t frequency;
+	// VBlank IRQ to ISR_Serial() entry, beyond fastest entry seen.
+	uint32_t vblank_latency[IRQ_STATS_BUCKETS];
+	// ISR_Serial() duration. Other interrupts wait meanwhile.
+	uint32_t isr_duration[IRQ_STATS_BUCKETS];
+	// VBlank interrupt masked by SystemDisableVBlankInterrupt().
+	uint32_t vblank_masked[IRQ_STATS_BUCKETS];
+	// VBlanks not serviced at all, since ISR was late by a frame or more.
+	uint32_t vblank_missed;
+	// Masked sections which ended with VBlank IRQ pending.
+	uint32_t vblank_delayed;
+	// Longest masked section and address passed to
+	// SystemEnableVBlankInterrupt() which ended it, i.e. return
+	// address of SerialWrite() caller.
+	uint32_t worst_masked;
+	uint32_t worst_masked_caller;
+	// SIO RX FIFO overruns, where received bytes were lost.
+	uint32_t sio_overruns;
+}TYPE_IRQ_STATS;
+
+/* **************************************
+ * 	Global Prototypes					*
+ * **************************************/
+
+// To be called on VBlank ISR entry and exit.
+void IrqStatsVBlankEnter(void);
+void IrqStatsVBlankExit(void);
+
+// To be called when VBlank IRQ is masked and unmasked again.
+// "caller" identifies code responsible for masked section.
+void IrqStatsMaskBegin(void);
+void IrqStatsMaskEnd(bool vblank_pending, void* caller);
+
+void IrqStatsCountSioOverrun(void);
+
+void IrqStatsGet(TYPE_IRQ_STATS* stats);
+
+#endif // __IRQ_STATS_HEADER__
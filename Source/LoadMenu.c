@@ -3,6 +3,7 @@
  * *************************************/
 
 #include "LoadMenu.h"
+#include "FontData.h"
 
 /* **************************************
  * 	Defines								*	
@@ -34,7 +35,9 @@ enum
 	
 	LOADING_BAR_WIDTH = 256,
 	LOADING_BAR_HEIGHT = 16,
+	LOADING_BAR_BORDER = 2,
 	
+	LOADING_BAR_BG_LUMINANCE = 0x20,
 	LOADING_BAR_LUMINANCE_TARGET = NORMAL_LUMINANCE,
 	LOADING_BAR_LUMINANCE_STEP = 10
 };
@@ -70,19 +73,27 @@ enum
  * 	Local Prototypes
  * *************************************/
  
-static void LoadMenuLoadFileList(	char* fileList[], 	void * dest[], 
-									uint8_t szFileList, uint8_t szDestList);
+static void LoadMenuLoadFileList(const TYPE_ASSET* assets, uint8_t nAssets);
+static bool LoadMenuLoadTIM(char* path, void* dest);
+static bool LoadMenuLoadCLT(char* path, void* dest);
+static bool LoadMenuLoadFNT(char* path, void* dest);
 
 /* *************************************
  * 	Local Variables
  * *************************************/
 
-static char* LoadMenuFiles[] = { "cdrom:\\DATA\\FONTS\\FONT_2.FNT;1"	};
-
-static void * LoadMenuDest[] = { (TYPE_FONT*)&SmallFont		};
+// Loader for each ASSET_TYPE.
+static bool (* const LoadMenuLoaders[MAX_ASSET_TYPE])(char* path, void* dest) =
+{
+	[ASSET_TYPE_TIM] = &LoadMenuLoadTIM,
+	[ASSET_TYPE_CLT] = &LoadMenuLoadCLT,
+	[ASSET_TYPE_FNT] = &LoadMenuLoadFNT
+};
 
 static char* strCurrentFile;
 
+static GsRectangle LoadMenuBar;
+
 // Flags to communicate with ISR state
 // 	*	startup_flag: background fades in from black to blue.
 // 	*	end_flag: tells the background to fade out to black.
@@ -105,10 +116,9 @@ void LoadMenuInit(void)
 	if(first_load == false)
 	{
 		first_load = true;
-		LoadMenuLoadFileList(	LoadMenuFiles,
-								LoadMenuDest,
-								sizeof(LoadMenuFiles) / sizeof(char*),
-								sizeof(LoadMenuDest)	/ sizeof(void*));
+		// Font is linked into the executable, so no CD-ROM access is
+		// needed before serial link is ready.
+		FontLoadEmbedded(&SmallFont, FontSmallData, FontSmallDataSize, FontSmallDataTimSize);
 	}
 	
 	FontSetSize(&SmallFont, SMALL_FONT_SIZE, SMALL_FONT_SIZE_BITSHIFT);
@@ -121,9 +131,7 @@ void LoadMenuInit(void)
 	GfxSetGlobalLuminance(NORMAL_LUMINANCE);
 }
 
-void LoadMenu(	char*	fileList[], 
-				void * dest[],
-				uint8_t szFileList	, uint8_t szDestList)
+void LoadMenu(const TYPE_ASSET* assets, uint8_t nAssets)
 {
 	
 	if(load_menu_running == false)
@@ -131,74 +139,136 @@ void LoadMenu(	char*	fileList[],
 		LoadMenuInit();
 	}
 	
-	LoadMenuLoadFileList(fileList,dest,szFileList,szDestList);
+	LoadMenuLoadFileList(assets, nAssets);
 }
 
-void LoadMenuLoadFileList(	char* fileList[], 	void * dest[], 
-							uint8_t szFileList, uint8_t szDestList)
+static bool LoadMenuLoadTIM(char* path, void* dest)
 {
-	char aux_file_name[100];
-	char* extension;
-	uint8_t fileLoadedCount;
-	
-	if(szFileList != szDestList)
+	return GfxSpriteFromFile(path, (GsSprite*)dest);
+}
+
+static bool LoadMenuLoadCLT(char* path, void* dest)
+{
+	if(dest != NULL)
 	{
-		dprintf("File list size different from dest list size! %d vs %d\n",
-				szFileList, szDestList);
-		return;
+		dprintf("WARNING: File %s linked to non-NULL destination pointer!\n", path);
 	}
 	
-	for(fileLoadedCount = 0; fileLoadedCount < szFileList ; fileLoadedCount++)
+	return GfxCLUTFromFile(path);
+}
+
+static bool LoadMenuLoadFNT(char* path, void* dest)
+{
+	return FontLoadImage(path, (TYPE_FONT*)dest);
+}
+
+/* *******************************************************************
+ *
+ * @name: static void LoadMenuLoadFileList(const TYPE_ASSET* assets, uint8_t nAssets)
+ *
+ * @brief:
+ * 	Loads each asset using the loader for its type. If expected size
+ * 	is given, it is checked against file size on disc first.
+ *
+ * *******************************************************************/
+
+static void LoadMenuLoadFileList(const TYPE_ASSET* assets, uint8_t nAssets)
+{
+	uint8_t i;
+	
+	for(i = 0; i < nAssets ; i++)
 	{
-		if(fileList[fileLoadedCount] == NULL)
+		const TYPE_ASSET* asset = &assets[i];
+		
+		if(asset->path == NULL)
 		{
 			continue;
 		}
 		
-		strCurrentFile = fileList[fileLoadedCount];
-						
-		//dprintf("Files %d / %d loaded. New plane X = %d.\n",fileLoadedCount,szFileList,LoadMenuPlaneSpr.x);
-		
-		// Backup original file path
-		strncpy(aux_file_name,fileList[fileLoadedCount],100);
-		
-		//We want to get file extension, so split into tokens
-		strtok(fileList[fileLoadedCount],".;");
-		extension = strtok(NULL,".;");
-		
-		dprintf("File extension: .%s\n",extension);
-		//Restore original file path in order to load file
-		strncpy(fileList[fileLoadedCount],aux_file_name,100);
-		
-		if(strncmp(extension,"TIM",3) == 0)
+		if(asset->type >= MAX_ASSET_TYPE)
 		{
-			if(GfxSpriteFromFile(fileList[fileLoadedCount], dest[fileLoadedCount]) == false)
-			{
-				dprintf("Could not load image file \"%s\"!\n",fileList[fileLoadedCount]);
-			}
+			dprintf("Unknown asset type %d for \"%s\"!\n", asset->type, asset->path);
+			continue;
 		}
-		else if(strncmp(extension,"CLT",3) == 0)
+		
+		strCurrentFile = asset->path;
+		
+		if(asset->size != 0)
 		{
-			if(dest[fileLoadedCount] != NULL)
+			// File is not read again by its loader, since it is kept open.
+			if(CdRomOpen(asset->path) == false)
 			{
-				dprintf("WARNING: File %s linked to non-NULL destination pointer!\n", dest[fileLoadedCount]);
+				dprintf("Could not find asset \"%s\"!\n", asset->path);
+				continue;
 			}
 			
-			if(GfxCLUTFromFile(fileList[fileLoadedCount]) == false)
+			if(CdRomGetFileSize() != asset->size)
 			{
-				dprintf("Could not load CLUT file \"%s\"!\n",fileList[fileLoadedCount]);
+				dprintf("Asset \"%s\" is %d bytes long, %d expected!\n",
+						asset->path, CdRomGetFileSize(), asset->size);
+				CdRomClose();
+				continue;
 			}
 		}
-		else if(strncmp(extension,"FNT",3) == 0)
+		
+		if(i < (nAssets - 1) )
 		{
-			if(FontLoadImage(fileList[fileLoadedCount], dest[fileLoadedCount]) == false)
-			{
-				dprintf("Could not load font file \"%s\"!\n",fileList[fileLoadedCount]);
-			}
+			// Next file is read from CD-ROM while current one is processed.
+			SystemSetNextFile(assets[i + 1].path);
 		}
-		else
+		
+		if(LoadMenuLoaders[asset->type](asset->path, asset->dest) == false)
 		{
-			dprintf("LoadMenu does not recognize following extension: %s\n",extension);
+			dprintf("Could not load asset \"%s\"!\n", asset->path);
 		}
 	}
 }
+
+/* *******************************************************************
+ *
+ * @name: void LoadMenuDrawProgressBar(fix16_t progress)
+ *
+ * @brief:
+ * 	Sorts a progress bar, where "progress" is the completed
+ * 	fraction in 16.16 fixed-point format (fix16_one == 100%).
+ *
+ * *******************************************************************/
+
+void LoadMenuDrawProgressBar(fix16_t progress)
+{
+	if(progress > fix16_one)
+	{
+		progress = fix16_one;
+	}
+	else if(progress < 0)
+	{
+		progress = 0;
+	}
+
+	GfxDirtyRect(LOADING_BAR_X, LOADING_BAR_Y, LOADING_BAR_WIDTH, LOADING_BAR_HEIGHT);
+
+	LoadMenuBar.x = LOADING_BAR_X;
+	LoadMenuBar.y = LOADING_BAR_Y;
+	LoadMenuBar.w = LOADING_BAR_WIDTH;
+	LoadMenuBar.h = LOADING_BAR_HEIGHT;
+
+	LoadMenuBar.r = LOADING_BAR_BG_LUMINANCE;
+	LoadMenuBar.g = LOADING_BAR_BG_LUMINANCE;
+	LoadMenuBar.b = LOADING_BAR_BG_LUMINANCE;
+
+	GfxSortRectangle(&LoadMenuBar);
+
+	LoadMenuBar.x += LOADING_BAR_BORDER;
+	LoadMenuBar.y += LOADING_BAR_BORDER;
+	LoadMenuBar.w = (short)(((LOADING_BAR_WIDTH - (LOADING_BAR_BORDER << 1)) * progress) >> 16);
+	LoadMenuBar.h -= LOADING_BAR_BORDER << 1;
+
+	LoadMenuBar.r = LOADING_BAR_LUMINANCE_TARGET;
+	LoadMenuBar.g = LOADING_BAR_LUMINANCE_TARGET;
+	LoadMenuBar.b = LOADING_BAR_LUMINANCE_TARGET;
+
+	if(LoadMenuBar.w > 0)
+	{
+		GfxSortRectangle(&LoadMenuBar);
+	}
+}
@@ -14,16 +14,45 @@
  * 	Defines
  * *************************************/
 
+/* *************************************
+ * 	Structs and enums
+ * *************************************/
+
+typedef enum t_AssetType
+{
+	ASSET_TYPE_TIM = 0,	// Destination: GsSprite
+	ASSET_TYPE_CLT,		// Destination: none (NULL)
+	ASSET_TYPE_FNT,		// Destination: TYPE_FONT
+	
+	MAX_ASSET_TYPE
+}ASSET_TYPE;
+
+// Asset to be loaded by LoadMenu(). "size" is the expected file
+// size in bytes, or 0 if it must not be checked.
+typedef struct t_Asset
+{
+	char* path;
+	ASSET_TYPE type;
+	void* dest;
+	size_t size;
+}TYPE_ASSET;
+
 /* *************************************
  * 	Global prototypes
  * *************************************/
 
 void LoadMenuInit(void);
 
-void LoadMenu(	char*	fileList[], 
-				void * dest[],
-				uint8_t szFileList	, uint8_t szDestList);
+// Loads all assets in list. List is not modified, so it can be
+// loaded again later.
+// Not called at the moment: loader font is linked into the
+// executable (see LoadMenuInit()), so nothing is read from disc on
+// boot. Kept, together with the TIM/CLUT streaming loaders and asset
+// archive lookup it relies on, for assets added later on.
+void LoadMenu(const TYPE_ASSET* assets, uint8_t nAssets);
 				
 void LoadMenuEnd(void);
 
+void LoadMenuDrawProgressBar(fix16_t progress);
+
 #endif //__LOAD_MENU_HEADER__
@@ -0,0 +1,128 @@
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include "Memory.h"
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+// All allocations are word-aligned so they can be used for DMA.
+#define MEMORY_ALIGN(size) (((size) + 3) & ~3)
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+static uint32_t memory_arena[MEMORY_ARENA_SIZE >> 2];
+static size_t arena_used;
+static size_t arena_peak;
+
+static uint32_t memory_pool[MEMORY_POOL_SIZE >> 2];
+static size_t pool_used;
+
+static uint16_t failed_allocs;
+
+/* *******************************************************************
+ *
+ * @name: void* MemoryAlloc(size_t size)
+ *
+ * @brief:
+ * 	Allocates "size" bytes from transient arena by bumping its
+ * 	position. Returns NULL if there is not enough room left.
+ *
+ * @remarks:
+ * 	Memory is freed in blocks by MemoryRelease(), so callers should
+ * 	take a mark before allocating and release it when done.
+ *
+ * *******************************************************************/
+
+void* MemoryAlloc(size_t size)
+{
+	void* ptr;
+
+	size = MEMORY_ALIGN(size);
+
+	if(size > (MEMORY_ARENA_SIZE - arena_used))
+	{
+		dprintf("MemoryAlloc: %d bytes requested, %d available!\n",
+				size, MEMORY_ARENA_SIZE - arena_used);
+		failed_allocs++;
+		return NULL;
+	}
+
+	ptr = (uint8_t*)memory_arena + arena_used;
+
+	arena_used += size;
+
+	if(arena_used > arena_peak)
+	{
+		arena_peak = arena_used;
+	}
+
+	return ptr;
+}
+
+MEMORY_MARK MemoryGetMark(void)
+{
+	return arena_used;
+}
+
+void MemoryRelease(MEMORY_MARK mark)
+{
+	if(mark <= arena_used)
+	{
+		arena_used = mark;
+	}
+	else
+	{
+		dprintf("MemoryRelease: invalid mark %d!\n", mark);
+	}
+}
+
+/* *******************************************************************
+ *
+ * @name: void* MemoryPoolAlloc(size_t size)
+ *
+ * @brief:
+ * 	Allocates "size" bytes from fixed pool. Returns NULL if there is
+ * 	not enough room left.
+ *
+ * @remarks:
+ * 	Kept apart from transient arena so releasing a mark never frees
+ * 	long-lived objects by accident.
+ *
+ * *******************************************************************/
+
+void* MemoryPoolAlloc(size_t size)
+{
+	void* ptr;
+
+	size = MEMORY_ALIGN(size);
+
+	if(size > (MEMORY_POOL_SIZE - pool_used))
+	{
+		dprintf("MemoryPoolAlloc: %d bytes requested, %d available!\n",
+				size, MEMORY_POOL_SIZE - pool_used);
+		failed_allocs++;
+		return NULL;
+	}
+
+	ptr = (uint8_t*)memory_pool + pool_used;
+
+	pool_used += size;
+
+	return ptr;
+}
+
+void MemoryReport(void)
+{
+	dprintf("Arena: peak %d / %d bytes\n", arena_peak, MEMORY_ARENA_SIZE);
+	dprintf("Pool: %d / %d bytes\n", pool_used, MEMORY_POOL_SIZE);
+
+	if(failed_allocs != 0)
+	{
+		dprintf("%d allocations failed!\n", failed_allocs);
+	}
+}
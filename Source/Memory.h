@@ -0,0 +1,46 @@
+#ifndef __MEMORY_HEADER__
+#define __MEMORY_HEADER__
+
+/* **************************************
+ * 	Includes							*
+ * **************************************/
+
+#include "Global_Inc.h"
+
+/* **************************************
+ * 	Defines								*
+ * **************************************/
+
+// Transient arena, for buffers only needed while loading.
+#define MEMORY_ARENA_SIZE	0x2000
+// Fixed pool, for objects which live until OpenSend ends.
+#define MEMORY_POOL_SIZE	0x400
+
+/* **************************************
+ * 	Structs and enums					*
+ * **************************************/
+
+// Arena position, used to free everything allocated after it.
+typedef size_t MEMORY_MARK;
+
+/* **************************************
+ * 	Global Prototypes					*
+ * **************************************/
+
+// Allocates "size" bytes from transient arena. Returns NULL if full.
+void* MemoryAlloc(size_t size);
+
+// Returns current arena position.
+MEMORY_MARK MemoryGetMark(void);
+
+// Frees all arena allocations done after "mark" was taken.
+void MemoryRelease(MEMORY_MARK mark);
+
+// Allocates "size" bytes from fixed pool. Returns NULL if full.
+// Pool allocations are never freed.
+void* MemoryPoolAlloc(size_t size);
+
+// Prints peak usage via dprintf().
+void MemoryReport(void);
+
+#endif // __MEMORY_HEADER__
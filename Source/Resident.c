@@ -0,0 +1,786 @@
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include "Resident.h"
+#include "Channel.h"
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+#define I_STAT (*(volatile unsigned int*)0x1F801070)
+#define I_MASK (*(volatile unsigned int*)0x1F801074)
+#define SIO_DATA (*(volatile uint8_t*)0x1F801040)
+#define SIO_STAT (*(volatile unsigned short*)0x1F801044)
+#define SIO_CTRL (*(volatile unsigned short*)0x1F80104A)
+#define SIO_STAT_TX_READY (1<<0)
+#define SIO_STAT_RX_NOT_EMPTY (1<<1)
+#define SIO_CTRL_ACK (1<<4)
+#define SIO_CTRL_TX_IRQ_ENABLE (1<<10)
+#define SIO_CTRL_RX_IRQ_ENABLE (1<<11)
+#define I_MASK_VBLANK (1<<0)
+#define I_MASK_TMR2 (1<<6)
+#define I_MASK_SIO (1<<8)
+#define RCNT2_MODE (*(volatile unsigned int*)0x1F801124)
+#define RCNT2_TARGET (*(volatile unsigned int*)0x1F801128)
+#define RCNT_MODE_RESET_AT_TARGET (1<<3)
+#define RCNT_MODE_IRQ_AT_TARGET (1<<4)
+#define RCNT_MODE_IRQ_REPEAT (1<<6)
+#define RCNT2_SYSCLOCK_DIV8 (2<<8)
+// 33.8688 MHz / 8.
+#define RESIDENT_PROFILE_CLOCK 4233600
+// Counter target is 16-bit wide.
+#define RESIDENT_PROFILE_MIN_RATE ((RESIDENT_PROFILE_CLOCK / 0xFFFF) + 1)
+// Interrupted PC and $ra.
+#define RESIDENT_PROFILE_SAMPLE_SIZE 8
+// Highest rate whose samples, framed, still fit into serial port
+// bandwidth (about 1300 Hz at 115200 bps). Samples get dropped
+// above it, or before if program also sends TTY output.
+#define RESIDENT_PROFILE_MAX_RATE	((SERIAL_BYTES_PER_SECOND * CHANNEL_MAX_PAYLOAD)	\
+									/ (RESIDENT_PROFILE_SAMPLE_SIZE							\
+									* (CHANNEL_HEADER_SIZE + CHANNEL_MAX_PAYLOAD + CHANNEL_TRAILER_SIZE)))
+#define KSEG_ADDRESS_MASK 0x1FFFFFFF
+#define KSEG1_BASE 0xA0000000
+// General exception vector. Both its cached and uncached addresses
+// are used, so instruction cache must be flushed after patching it.
+#define EXCEPTION_VECTOR ((volatile uint32_t*)0x80000080)
+#define EXCEPTION_VECTOR_WORDS 4
+#define MIPS_J_OPCODE 0x08000000
+#define MIPS_J_TARGET_MASK 0x03FFFFFF
+#define MIPS_NOP 0x00000000
+// Jump and its delay slot.
+#define RESIDENT_TRAMPOLINE_SIZE 8
+#define RESIDENT_PATCH_AREA_SIZE 0x4000
+#define RESIDENT_MAX_PATCHES 32
+#define RESIDENT_STACK_SIZE 0x400
+// Stack assumed to be used by PSX-EXE when its header leaves stack
+// size as 0.
+#define RESIDENT_EXE_MIN_STACK_SIZE 0x2000
+// $1-$25, $28-$31, HI, LO, EPC.
+#define RESIDENT_CONTEXT_WORDS 32
+#define RESIDENT_CONTEXT_RA 28
+#define RESIDENT_CONTEXT_EPC 31
+// Polling loops to wait for each byte from PC before giving up,
+// so that program is not stopped forever if PC goes away.
+#define RESIDENT_RX_TIMEOUT 0x100000
+// BIOS function tables, kept in RAM. Putchar entries are replaced
+// so that TTY output of running program goes into CHANNEL_TTY.
+#define BIOS_A0_TABLE ((volatile uint32_t*)0x80000200)
+#define BIOS_B0_TABLE ((volatile uint32_t*)0x80000874)
+#define BIOS_A0_PUTCHAR 0x3C
+#define BIOS_B0_STD_OUT_PUTCHAR 0x3D
+#define RESIDENT_STRINGIFY_(x) #x
+#define RESIDENT_STRINGIFY(x) RESIDENT_STRINGIFY_(x)
+
+/* *************************************
+ * 	Structs and enums
+ * *************************************/
+
+// Values returned by ResidentService() to ResidentHandler.
+enum
+{
+	RESIDENT_CHAIN = 0,
+	RESIDENT_RETURN_TO_LOADER
+};
+
+typedef struct t_ResidentPatch
+{
+	uint32_t old_entry;
+	uint32_t new_entry;
+}TYPE_RESIDENT_PATCH;
+
+/* *************************************
+ * 	Local Prototypes
+ * *************************************/
+
+void ResidentHandler(void);
+void ResidentSoftReturn(void);
+uint32_t ResidentService(void);
+void ResidentFlushICache(void);
+static bool ResidentReadByte(uint8_t* byte);
+static bool ResidentReadWord(uint32_t* word);
+static void ResidentWriteByte(uint8_t byte);
+static void ResidentWriteWord(uint32_t word);
+static void ResidentReceivePatches(void);
+static bool ResidentInstallPatches(uint32_t epc);
+static void ResidentSetProfileRate(uint32_t rate);
+void ResidentTtyPutchar(int c);
+extern void _start(void);
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+// Original exception vector instructions, followed by a jump back
+// to the rest of it. Exceptions not meant for OpenSend go through it.
+// BIOS vector only uses absolute addresses, so it can run from here.
+uint32_t ResidentChain[EXCEPTION_VECTOR_WORDS + 2];
+// Registers of interrupted program, saved by ResidentHandler:
+// $1-$25, $28-$31, HI, LO and EPC.
+uint32_t ResidentContext[RESIDENT_CONTEXT_WORDS];
+// ResidentService() runs on its own stack, so that program stack
+// is not modified.
+uint32_t ResidentStack[RESIDENT_STACK_SIZE >> 2] __attribute__((aligned(8)));
+// Code of patched functions, linked by PC at its final address.
+static uint32_t ResidentPatchArea[RESIDENT_PATCH_AREA_SIZE >> 2];
+static size_t patch_area_used;
+// Trampolines waiting for next VBlank to be installed.
+static TYPE_RESIDENT_PATCH patches[RESIDENT_MAX_PATCHES];
+static uint8_t patches_pending;
+// Original BIOS putchar entries, restored by ResidentSoftReturn().
+static uint32_t bios_a0_putchar;
+static uint32_t bios_b0_putchar;
+
+/* *******************************************************************
+ *
+ * 	ResidentHandler: installed on general exception vector.
+ *
+ * 	When SIO or VBlank interrupts are pending, registers are saved
+ * 	into ResidentContext[] and ResidentService() is called. Then,
+ * 	registers are restored and original BIOS exception handler is
+ * 	executed, or, on RESIDENT_RETURN_TO_LOADER, stack is reset to
+ * 	loader's and exception returns into ResidentSoftReturn().
+ *
+ * *******************************************************************/
+
+__asm__(
+"	.text\n"
+"	.globl ResidentHandler\n"
+"	.set push\n"
+"	.set noreorder\n"
+"	.set noat\n"
+"ResidentHandler:\n"
+"	lui $k0, 0x1F80\n"
+"	lw $k1, 0x1070($k0)\n"		// I_STAT
+"	lw $k0, 0x1074($k0)\n"		// I_MASK
+"	nop\n"
+"	and $k1, $k1, $k0\n"
+"	andi $k1, $k1, 0x141\n"		// SIO, root counter 2 or VBlank
+"	beqz $k1, 2f\n"
+"	nop\n"
+"	lui $k0, %hi(ResidentContext)\n"
+"	addiu $k0, $k0, %lo(ResidentContext)\n"
+"	sw $1, 0($k0)\n"
+"	sw $2, 4($k0)\n"
+"	sw $3, 8($k0)\n"
+"	sw $4, 12($k0)\n"
+"	sw $5, 16($k0)\n"
+"	sw $6, 20($k0)\n"
+"	sw $7, 24($k0)\n"
+"	sw $8, 28($k0)\n"
+"	sw $9, 32($k0)\n"
+"	sw $10, 36($k0)\n"
+"	sw $11, 40($k0)\n"
+"	sw $12, 44($k0)\n"
+"	sw $13, 48($k0)\n"
+"	sw $14, 52($k0)\n"
+"	sw $15, 56($k0)\n"
+"	sw $16, 60($k0)\n"
+"	sw $17, 64($k0)\n"
+"	sw $18, 68($k0)\n"
+"	sw $19, 72($k0)\n"
+"	sw $20, 76($k0)\n"
+"	sw $21, 80($k0)\n"
+"	sw $22, 84($k0)\n"
+"	sw $23, 88($k0)\n"
+"	sw $24, 92($k0)\n"
+"	sw $25, 96($k0)\n"
+"	sw $28, 100($k0)\n"
+"	sw $29, 104($k0)\n"
+"	sw $30, 108($k0)\n"
+"	sw $31, 112($k0)\n"
+"	mfhi $k1\n"
+"	sw $k1, 116($k0)\n"
+"	mflo $k1\n"
+"	sw $k1, 120($k0)\n"
+"	mfc0 $k1, $14\n"			// EPC
+"	nop\n"
+"	sw $k1, 124($k0)\n"
+"	lui $sp, %hi(ResidentStack + " RESIDENT_STRINGIFY(RESIDENT_STACK_SIZE) ")\n"
+"	jal ResidentService\n"
+"	addiu $sp, $sp, %lo(ResidentStack + " RESIDENT_STRINGIFY(RESIDENT_STACK_SIZE) ")\n"
+"	move $k1, $v0\n"
+"	lui $k0, %hi(ResidentContext)\n"
+"	addiu $k0, $k0, %lo(ResidentContext)\n"
+"	lw $1, 116($k0)\n"
+"	nop\n"
+"	mthi $1\n"
+"	lw $1, 120($k0)\n"
+"	nop\n"
+"	mtlo $1\n"
+"	lw $1, 0($k0)\n"
+"	lw $2, 4($k0)\n"
+"	lw $3, 8($k0)\n"
+"	lw $4, 12($k0)\n"
+"	lw $5, 16($k0)\n"
+"	lw $6, 20($k0)\n"
+"	lw $7, 24($k0)\n"
+"	lw $8, 28($k0)\n"
+"	lw $9, 32($k0)\n"
+"	lw $10, 36($k0)\n"
+"	lw $11, 40($k0)\n"
+"	lw $12, 44($k0)\n"
+"	lw $13, 48($k0)\n"
+"	lw $14, 52($k0)\n"
+"	lw $15, 56($k0)\n"
+"	lw $16, 60($k0)\n"
+"	lw $17, 64($k0)\n"
+"	lw $18, 68($k0)\n"
+"	lw $19, 72($k0)\n"
+"	lw $20, 76($k0)\n"
+"	lw $21, 80($k0)\n"
+"	lw $22, 84($k0)\n"
+"	lw $23, 88($k0)\n"
+"	lw $24, 92($k0)\n"
+"	lw $25, 96($k0)\n"
+"	lw $28, 100($k0)\n"
+"	lw $29, 104($k0)\n"
+"	lw $30, 108($k0)\n"
+"	lw $31, 112($k0)\n"
+"	beqz $k1, 2f\n"				// RESIDENT_CHAIN
+"	nop\n"
+"	lui $sp, %hi(" RESIDENT_STRINGIFY(SYSTEM_STACK_TOP) ")\n"	// Loader stack
+"	addiu $sp, $sp, %lo(" RESIDENT_STRINGIFY(SYSTEM_STACK_TOP) ")\n"
+"	lui $k0, %hi(ResidentSoftReturn)\n"
+"	addiu $k0, $k0, %lo(ResidentSoftReturn)\n"
+"	jr $k0\n"
+"	rfe\n"
+"2:\n"
+"	lui $k0, %hi(ResidentChain)\n"
+"	addiu $k0, $k0, %lo(ResidentChain)\n"
+"	jr $k0\n"
+"	nop\n"
+"	.set pop\n"
+);
+
+/* *******************************************************************
+ *
+ * 	ResidentFlushICache: invalidates whole instruction cache by
+ * 	isolating it and writing to every line. It must be executed from
+ * 	uncached memory (KSEG1), so it does not call BIOS and can be used
+ * 	from exception context.
+ *
+ * *******************************************************************/
+
+__asm__(
+"	.text\n"
+"	.globl ResidentFlushICache\n"
+"	.set push\n"
+"	.set noreorder\n"
+"ResidentFlushICache:\n"
+"	mfc0 $t0, $12\n"			// Status register
+"	li $t1, -2\n"
+"	and $t1, $t0, $t1\n"		// Interrupts disabled
+"	lui $t2, 0x0003\n"			// Isolate and swap caches
+"	or $t1, $t1, $t2\n"
+"	mtc0 $t1, $12\n"
+"	nop\n"
+"	nop\n"
+"	move $t1, $zero\n"
+"	li $t2, 0x1000\n"			// 4 kB, 16 bytes per line
+"1:\n"
+"	sw $zero, 0($t1)\n"
+"	addiu $t1, $t1, 16\n"
+"	bne $t1, $t2, 1b\n"
+"	nop\n"
+"	mtc0 $t0, $12\n"
+"	nop\n"
+"	nop\n"
+"	jr $ra\n"
+"	nop\n"
+"	.set pop\n"
+);
+
+/* *******************************************************************
+ *
+ * @name: uint32_t ResidentService(void)
+ *
+ * @brief:
+ * 	Called by ResidentHandler, in exception context, with program
+ * 	registers saved and interrupts disabled, so program is stopped.
+ *
+ * 	*	SIO: received bytes are read. RESIDENT_MAGIC_RETURN makes
+ * 		OpenSend take over again. RESIDENT_MAGIC_PATCH receives
+ * 		functions to be patched (see ResidentReceivePatches()).
+ * 	*	VBlank: pending trampolines are installed, as long as
+ * 		program is not stopped on any of them.
+ *
+ * 	VBlank interrupt is never acknowledged, so that program's own
+ * 	handler still gets it through BIOS.
+ *
+ * @return:
+ * 	RESIDENT_CHAIN, or RESIDENT_RETURN_TO_LOADER.
+ *
+ * *******************************************************************/
+
+uint32_t ResidentService(void)
+{
+	uint32_t pending = I_STAT & I_MASK;
+
+	if(pending & I_MASK_SIO)
+	{
+		SIO_CTRL |= SIO_CTRL_ACK;
+		I_STAT = ~I_MASK_SIO;
+
+		while(SIO_STAT & SIO_STAT_RX_NOT_EMPTY)
+		{
+			switch((uint8_t)SIO_DATA)
+			{
+				case RESIDENT_MAGIC_RETURN:
+				return RESIDENT_RETURN_TO_LOADER;
+
+				case RESIDENT_MAGIC_PATCH:
+					ResidentReceivePatches();
+				break;
+
+				case RESIDENT_MAGIC_PROFILE:
+				{
+					uint32_t rate;
+
+					if(ResidentReadWord(&rate) == true)
+					{
+						ResidentSetProfileRate(rate);
+					}
+				}
+				break;
+
+				default:
+				break;
+			}
+		}
+
+		ChannelService();
+	}
+
+	if(pending & I_MASK_TMR2)
+	{
+		uint32_t sample[] = {	ResidentContext[RESIDENT_CONTEXT_EPC],
+								ResidentContext[RESIDENT_CONTEXT_RA]	};
+
+		I_STAT = ~I_MASK_TMR2;
+
+		// Dropped if PC does not keep up with sampling rate.
+		ChannelWrite(CHANNEL_PROFILE, sample, sizeof(sample));
+	}
+
+	if( (pending & I_MASK_VBLANK) && (patches_pending != 0) )
+	{
+		ResidentInstallPatches(ResidentContext[RESIDENT_CONTEXT_EPC]);
+	}
+
+	if(pending & I_MASK_VBLANK)
+	{
+		// Restarts transmission if TX interrupt was missed.
+		ChannelService();
+	}
+
+	return RESIDENT_CHAIN;
+}
+
+/* *******************************************************************
+ *
+ * @name: static void ResidentReceivePatches(void)
+ *
+ * @brief:
+ * 	Receives new versions of program functions:
+ *
+ * 	1.	PSX sends next free address inside patch area and number of
+ * 		free bytes (32-bit words), so PC can link new functions there
+ * 		(see Tools/HotPatch.c).
+ * 	2.	PC sends number of functions (32-bit word). PSX answers
+ * 		ACK, or NACK if there is no room for them.
+ * 	3.	For each function, PC sends old entry point, code size,
+ * 		code and its Adler-32 (all words little-endian). Code is
+ * 		placed right after previous one, word-aligned. PSX answers
+ * 		ACK, or NACK so PC sends that function again.
+ *
+ * @remarks:
+ * 	Batch is only made pending once all functions have been
+ * 	received, so its jumps are installed together on next VBlank.
+ * 	If transfer fails halfway, patch area and pending patches are
+ * 	left as they were, so old and new functions are never mixed.
+ *
+ * *******************************************************************/
+
+static void ResidentReceivePatches(void)
+{
+	uint32_t nPatches;
+	uint32_t i;
+	// Only committed once whole batch has been received.
+	size_t used = patch_area_used;
+
+	ResidentWriteWord((uint32_t)ResidentPatchArea + used);
+	ResidentWriteWord(RESIDENT_PATCH_AREA_SIZE - used);
+
+	if(	(ResidentReadWord(&nPatches) == false)
+				||
+		(nPatches > (uint32_t)(RESIDENT_MAX_PATCHES - patches_pending))	)
+	{
+		ResidentWriteByte(NACK_BYTE_STRING[0]);
+		return;
+	}
+
+	ResidentWriteByte(ACK_BYTE_STRING[0]);
+
+	for(i = 0; i < nPatches; )
+	{
+		TYPE_RESIDENT_PATCH* patch = &patches[patches_pending + i];
+		uint8_t* code = (uint8_t*)ResidentPatchArea + used;
+		uint32_t old_entry;
+		uint32_t size;
+		uint32_t checksum;
+		uint32_t j;
+
+		if( (ResidentReadWord(&old_entry) == false) || (ResidentReadWord(&size) == false) )
+		{
+			return;
+		}
+
+		if(size > (RESIDENT_PATCH_AREA_SIZE - used))
+		{
+			ResidentWriteByte(NACK_BYTE_STRING[0]);
+			return;
+		}
+
+		for(j = 0; j < size; j++)
+		{
+			if(ResidentReadByte(&code[j]) == false)
+			{
+				return;
+			}
+		}
+
+		if(ResidentReadWord(&checksum) == false)
+		{
+			return;
+		}
+
+		if(SystemAdler32(1, code, size) != checksum)
+		{
+			ResidentWriteByte(NACK_BYTE_STRING[0]);
+			continue;
+		}
+
+		patch->old_entry = old_entry;
+		patch->new_entry = (uint32_t)code;
+
+		used += (size + 3) & ~3;
+		i++;
+
+		ResidentWriteByte(ACK_BYTE_STRING[0]);
+	}
+
+	patch_area_used = used;
+	patches_pending += nPatches;
+}
+
+/* *******************************************************************
+ *
+ * @name: static bool ResidentInstallPatches(uint32_t epc)
+ *
+ * @brief:
+ * 	Replaces first two instructions of each old function with a
+ * 	jump to its new version. Nothing is installed if program was
+ * 	stopped ("epc") on any of the instructions to be replaced, so
+ * 	all trampolines are installed at once on a later VBlank.
+ *
+ * *******************************************************************/
+
+static bool ResidentInstallPatches(uint32_t epc)
+{
+	void (*flush)(void);
+	uint8_t i;
+
+	for(i = 0; i < patches_pending; i++)
+	{
+		if( (epc >= patches[i].old_entry) && (epc < (patches[i].old_entry + RESIDENT_TRAMPOLINE_SIZE)) )
+		{
+			return false;
+		}
+	}
+
+	for(i = 0; i < patches_pending; i++)
+	{
+		volatile uint32_t* entry = (volatile uint32_t*)patches[i].old_entry;
+
+		entry[0] = MIPS_J_OPCODE | ((patches[i].new_entry >> 2) & MIPS_J_TARGET_MASK);
+		entry[1] = MIPS_NOP;
+	}
+
+	patches_pending = 0;
+
+	// Cache can only be flushed from uncached memory.
+	flush = (void (*)(void))(((uint32_t)&ResidentFlushICache & KSEG_ADDRESS_MASK) | KSEG1_BASE);
+	flush();
+
+	return true;
+}
+
+static bool ResidentReadByte(uint8_t* byte)
+{
+	uint32_t timeout = RESIDENT_RX_TIMEOUT;
+
+	while(!(SIO_STAT & SIO_STAT_RX_NOT_EMPTY))
+	{
+		if(--timeout == 0)
+		{
+			return false;
+		}
+	}
+
+	*byte = SIO_DATA;
+
+	return true;
+}
+
+static bool ResidentReadWord(uint32_t* word)
+{
+	uint8_t i;
+
+	*word = 0;
+
+	for(i = 0; i < sizeof(uint32_t); i++)
+	{
+		uint8_t byte;
+
+		if(ResidentReadByte(&byte) == false)
+		{
+			return false;
+		}
+
+		*word |= byte << (i << 3);
+	}
+
+	return true;
+}
+
+/* *******************************************************************
+ *
+ * @name: static void ResidentSetProfileRate(uint32_t rate)
+ *
+ * @brief:
+ * 	Starts sampling program counter "rate" times per second, using
+ * 	root counter 2 interrupt. Each sample (interrupted PC and $ra)
+ * 	is sent through CHANNEL_PROFILE. Sampling stops when "rate" is 0.
+ * 	ACK is sent if rate was accepted, NACK otherwise.
+ *
+ * @remarks:
+ * 	Root counter 2 must not be used by running PSX-EXE.
+ *
+ * *******************************************************************/
+
+static void ResidentSetProfileRate(uint32_t rate)
+{
+	I_MASK &= ~I_MASK_TMR2;
+	RCNT2_MODE = 0;
+	I_STAT = ~I_MASK_TMR2;
+
+	if(rate == 0)
+	{
+		ResidentWriteByte(ACK_BYTE_STRING[0]);
+		return;
+	}
+
+	if( (rate < RESIDENT_PROFILE_MIN_RATE) || (rate > RESIDENT_PROFILE_MAX_RATE) )
+	{
+		ResidentWriteByte(NACK_BYTE_STRING[0]);
+		return;
+	}
+
+	RCNT2_TARGET = RESIDENT_PROFILE_CLOCK / rate;
+	RCNT2_MODE = RCNT2_SYSCLOCK_DIV8 | RCNT_MODE_RESET_AT_TARGET | RCNT_MODE_IRQ_AT_TARGET | RCNT_MODE_IRQ_REPEAT;
+	I_MASK |= I_MASK_TMR2;
+
+	ResidentWriteByte(ACK_BYTE_STRING[0]);
+}
+
+// Replies are sent through CHANNEL_CONTROL, so they are framed
+// like the rest of data sent while PSX-EXE runs.
+static void ResidentWriteByte(uint8_t byte)
+{
+	ChannelWrite(CHANNEL_CONTROL, &byte, sizeof(byte));
+	ChannelFlush(CHANNEL_CONTROL);
+}
+
+static void ResidentWriteWord(uint32_t word)
+{
+	uint8_t bytes[sizeof(uint32_t)];
+	uint8_t i;
+
+	for(i = 0; i < sizeof(uint32_t); i++)
+	{
+		bytes[i] = (uint8_t)(word >> (i << 3));
+	}
+
+	ChannelWrite(CHANNEL_CONTROL, bytes, sizeof(bytes));
+	ChannelFlush(CHANNEL_CONTROL);
+}
+
+/* *******************************************************************
+ *
+ * @name: void ResidentTtyPutchar(int c)
+ *
+ * @brief:
+ * 	Replaces BIOS putchar, so printf() from running program is
+ * 	redirected to PC through CHANNEL_TTY. Caller never waits for
+ * 	serial port: characters are dropped if channel is full.
+ *
+ * @remarks:
+ * 	Runs on program context. Resident.c and Channel.c are built with
+ * 	-G0, so globals are not accessed through program's $gp.
+ *
+ * *******************************************************************/
+
+void ResidentTtyPutchar(int c)
+{
+	uint8_t byte = (uint8_t)c;
+
+	ChannelWrite(CHANNEL_TTY, &byte, sizeof(byte));
+}
+
+/* *******************************************************************
+ *
+ * @name: void ResidentInstall(void)
+ *
+ * @brief:
+ * 	Copies original exception vector into ResidentChain[], replaces
+ * 	it with a jump to ResidentHandler and enables SIO RX interrupt.
+ * 	BIOS putchar is redirected into CHANNEL_TTY.
+ *
+ * @remarks:
+ * 	Hook stays active as long as running PSX-EXE keeps SIO interrupt
+ * 	enabled and does not replace exception vector itself. SIO must
+ * 	not be used by PSX-EXE, since received bytes are consumed here.
+ *
+ * *******************************************************************/
+
+void ResidentInstall(void)
+{
+	uint8_t i;
+
+	I_MASK &= ~I_MASK_SIO;
+
+	for(i = 0; i < EXCEPTION_VECTOR_WORDS; i++)
+	{
+		ResidentChain[i] = EXCEPTION_VECTOR[i];
+	}
+
+	// Continue after original instructions.
+	ResidentChain[EXCEPTION_VECTOR_WORDS] = MIPS_J_OPCODE
+		| ((((uint32_t)&EXCEPTION_VECTOR[EXCEPTION_VECTOR_WORDS]) >> 2) & MIPS_J_TARGET_MASK);
+	ResidentChain[EXCEPTION_VECTOR_WORDS + 1] = MIPS_NOP;
+
+	EXCEPTION_VECTOR[0] = MIPS_J_OPCODE | ((((uint32_t)&ResidentHandler) >> 2) & MIPS_J_TARGET_MASK);
+	EXCEPTION_VECTOR[1] = MIPS_NOP;
+
+	ChannelInit();
+
+	bios_a0_putchar = BIOS_A0_TABLE[BIOS_A0_PUTCHAR];
+	bios_b0_putchar = BIOS_B0_TABLE[BIOS_B0_STD_OUT_PUTCHAR];
+	BIOS_A0_TABLE[BIOS_A0_PUTCHAR] = (uint32_t)&ResidentTtyPutchar;
+	BIOS_B0_TABLE[BIOS_B0_STD_OUT_PUTCHAR] = (uint32_t)&ResidentTtyPutchar;
+
+	SystemFlushCache();
+
+	SIO_CTRL |= SIO_CTRL_RX_IRQ_ENABLE;
+	I_MASK |= I_MASK_SIO;
+}
+
+/* *******************************************************************
+ *
+ * @name: void ResidentSoftReturn(void)
+ *
+ * @brief:
+ * 	Entered from ResidentHandler, with loader stack. Restores BIOS
+ * 	exception vector and restarts OpenSend, so a new PSX-EXE can
+ * 	be uploaded without resetting the console.
+ *
+ * *******************************************************************/
+
+void ResidentSoftReturn(void)
+{
+	uint8_t i;
+
+	I_MASK = 0;
+	RCNT2_MODE = 0;
+
+	SIO_CTRL &= ~(SIO_CTRL_RX_IRQ_ENABLE | SIO_CTRL_TX_IRQ_ENABLE);
+
+	for(i = 0; i < EXCEPTION_VECTOR_WORDS; i++)
+	{
+		EXCEPTION_VECTOR[i] = ResidentChain[i];
+	}
+
+	BIOS_A0_TABLE[BIOS_A0_PUTCHAR] = bios_a0_putchar;
+	BIOS_B0_TABLE[BIOS_B0_STD_OUT_PUTCHAR] = bios_b0_putchar;
+
+	SystemFlushCache();
+
+	// Startup code clears BSS and calls main() again. .data is not
+	// reloaded, so OpenSend state must not rely on initialized
+	// mutable variables.
+	_start();
+}
+
+/* *******************************************************************
+ *
+ * @name: bool ResidentIsExeRangeSafe(uint32_t address, uint32_t size)
+ *
+ * @brief:
+ * 	Returns false if given range overlaps OpenSend code, data or
+ * 	BSS, which resident handler and patch area live in. Loader stack
+ * 	is not needed once PSX-EXE runs, so it can be used by PSX-EXE.
+ *
+ * *******************************************************************/
+
+bool ResidentIsExeRangeSafe(uint32_t address, uint32_t size)
+{
+	uint32_t start = (uint32_t)&_start & KSEG_ADDRESS_MASK;
+	uint32_t end = (SYSTEM_STACK_TOP - SYSTEM_STACK_SIZE) & KSEG_ADDRESS_MASK;
+
+	address &= KSEG_ADDRESS_MASK;
+
+	if( (size == 0) || (address >= end) )
+	{
+		return true;
+	}
+	else if(address >= start)
+	{
+		return false;
+	}
+
+	return size <= (start - address);
+}
+
+/* *******************************************************************
+ *
+ * @name: bool ResidentIsExeStackSafe(uint32_t address, uint32_t size)
+ *
+ * @brief:
+ * 	Same as ResidentIsExeRangeSafe(), for stack described by PSX-EXE
+ * 	header. Stack grows down from address + size. Size is usually
+ * 	left as 0, so at least RESIDENT_EXE_MIN_STACK_SIZE bytes are
+ * 	assumed to be used then.
+ *
+ * 	Zero address means PSX-EXE keeps stack it is started with,
+ * 	which is loader's.
+ *
+ * *******************************************************************/
+
+bool ResidentIsExeStackSafe(uint32_t address, uint32_t size)
+{
+	uint32_t top = address + size;
+
+	if(address == 0)
+	{
+		return true;
+	}
+
+	if(size < RESIDENT_EXE_MIN_STACK_SIZE)
+	{
+		size = RESIDENT_EXE_MIN_STACK_SIZE;
+	}
+
+	return ResidentIsExeRangeSafe(top - size, size);
+}
@@ -0,0 +1,44 @@
+#ifndef __RESIDENT_HEADER__
+#define __RESIDENT_HEADER__
+
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include "Global_Inc.h"
+#include "System.h"
+#include "Serial.h"
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+// Byte sent by PC to stop running PSX-EXE and go back to loader
+// (ASCII 'Q'). Numeric, since it is also used from assembly.
+#define RESIDENT_MAGIC_RETURN 0x51
+// Byte sent by PC to replace functions of running PSX-EXE ('P').
+// See ResidentReceivePatches().
+#define RESIDENT_MAGIC_PATCH 0x50
+// Byte sent by PC to start PC-sampling profiler ('S'), followed by
+// sampling rate in Hz (32-bit word, 0 stops it).
+// See ResidentSetProfileRate().
+#define RESIDENT_MAGIC_PROFILE 0x53
+
+/* *************************************
+ * 	Global prototypes
+ * *************************************/
+
+// Hooks exception vector so that OpenSend takes control again when
+// RESIDENT_MAGIC_RETURN is received, and functions can be patched. To be called right before
+// running PSX-EXE, once BIOS state has been restored.
+// Data sent to PC from then on is framed (see Channel.h).
+// printf() output from PSX-EXE (BIOS putchar) goes to CHANNEL_TTY.
+void ResidentInstall(void);
+
+// Return whether PSX-EXE text and BSS, or its stack (as described by
+// PSX-EXE header), leave OpenSend intact, so it can be used in
+// resident mode.
+bool ResidentIsExeRangeSafe(uint32_t address, uint32_t size);
+bool ResidentIsExeStackSafe(uint32_t address, uint32_t size);
+
+#endif // __RESIDENT_HEADER__
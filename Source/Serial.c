@@ -8,10 +8,22 @@
  * 	Defines
  * *************************************/
 
-#define SERIAL_BAUDRATE 115200
 #define SERIAL_TX_RX_TIMEOUT 20000
 #define SERIAL_RX_FIFO_EMPTY 0
 #define SERIAL_TX_NOT_READY 0
+// Highest integer value that fits in a fix16_t.
+#define SERIAL_FIX16_MAX_INT 0x7FFF
+// Must be a power of 2.
+#define SERIAL_RX_BUFFER_SIZE 64
+// Memory read/write commands transfer data in blocks of this size,
+// each one followed by its Adler-32 checksum and acknowledged.
+#define SERIAL_MEM_BLOCK_SIZE 256
+// VRAM is captured in chunks of (at most) this size, double buffered.
+#define SERIAL_VRAM_CHUNK_SIZE 2048
+#define SIO_STAT (*(volatile unsigned short*)0x1F801044)
+#define SIO_CTRL (*(volatile unsigned short*)0x1F80104A)
+#define SIO_STAT_RX_OVERRUN (1<<4)
+#define SIO_CTRL_ACK (1<<4)
 
 /* *************************************
  * 	Local Variables
@@ -24,13 +36,65 @@ static volatile uint32_t RAMDest_Address;
 static volatile size_t ExeSize;
 static volatile size_t totalBytes;
 static volatile size_t exeBytesRead;
+// Received fraction of PSX-EXE data, where 0xFFFFFFFF means 100%.
+// It is increased by progress_step per byte, so no division is
+// needed when receiving data.
+static volatile uint32_t progress;
+static uint32_t progress_step;
+// Throughput is calculated from last sample, taken once per second.
+static uint32_t rate_timestamp;
+static size_t rate_bytes;
+static fix16_t bytes_per_second;
+static uint32_t eta_seconds;
 static volatile bool serial_busy;
+// PC asked to run PSX-EXE without end animation.
+static bool instant_exec;
+// PC asked to keep OpenSend resident while PSX-EXE runs.
+static bool resident_exec;
+// Bytes received from SIO while waiting for other tasks (i.e.: GPU).
+// Hardware RX FIFO is only 8 bytes long, so it must be emptied often.
+static uint8_t rx_buffer[SERIAL_RX_BUFFER_SIZE];
+static volatile uint8_t rx_head;
+static volatile uint8_t rx_tail;
+// Data streamed by SerialBlockWrite(), not sent yet because it does
+// not fill a whole block.
+static uint8_t block_buffer[SERIAL_MEM_BLOCK_SIZE];
+static size_t block_used;
 
 /* *************************************
  * 	Local Prototypes
  * *************************************/
 
+static void SerialUpdateThroughput(void);
+static bool SerialReadWord(uint32_t* word);
+static bool SerialWriteFramed(CHANNEL_ID ch, const void* data, size_t n);
+static bool SerialIsValidRange(uint32_t address, uint32_t size, bool write);
+static bool SerialMemRead(uint8_t* address, uint32_t size);
+static bool SerialSendBlock(const uint8_t* data, uint32_t size);
+static bool SerialBlockWrite(const void* data, size_t n);
+static bool SerialBlockFlush(void);
+static void SerialMemWrite(uint8_t* address, uint32_t size);
+static void SerialIsr(void);
+static void SerialVBlankHandler(void);
+static void SerialCheckOverrun(void);
+
 void ISR_Serial(void)
+{
+    SystemCallOnIsrStack(&SerialIsr);
+}
+
+static void SerialIsr(void)
+{
+    IrqStatsVBlankEnter();
+    TRACE_BEGIN(TRACE_EVENT_VBLANK_ISR, 0);
+
+    SerialVBlankHandler();
+
+    TRACE_END(TRACE_EVENT_VBLANK_ISR, 0);
+    IrqStatsVBlankExit();
+}
+
+static void SerialVBlankHandler(void)
 {
     enum
     {
@@ -78,10 +142,34 @@ void ISR_Serial(void)
     {
         SERIAL_STATE_TEXT_X = 148,
         SERIAL_STATE_TEXT_Y = Y_SCREEN_RESOLUTION >> 1,
+        SERIAL_RAM_DEST_TEXT_Y = SERIAL_STATE_TEXT_Y + 16,
+        SERIAL_INIT_PC_TEXT_Y = SERIAL_STATE_TEXT_Y + 32,
+        SERIAL_EXE_SIZE_TEXT_Y = SERIAL_STATE_TEXT_Y + 48,
+        SERIAL_THROUGHPUT_TEXT_Y = SERIAL_STATE_TEXT_Y + 64,
+        // Above state text, since loading bar is drawn below it.
+        SERIAL_STACK_TEXT_Y = SERIAL_STATE_TEXT_Y - 16,
     };
 
+    // Values already shown on screen. Only lines whose values
+    // have changed are redrawn.
+    static bool bg_cached;
+    // Set when background has just been drawn, so all lines are
+    // drawn once, regardless of shown_* caches (e.g.: while a value
+    // is still 0).
+    bool redraw_all = false;
+    static uint32_t shown_RAMDest_Address;
+    static uint32_t shown_initPC_Address;
+    static size_t shown_ExeSize;
+#ifdef PSXSDK_DEBUG
+    static uint32_t shown_stack_used;
+    static uint32_t shown_isr_stack_used;
+    TYPE_STACK_STATS stack_stats;
+#endif // PSXSDK_DEBUG
+
     SystemIncreaseGlobalTimer();
 
+    GfxFenceHandler();
+
     if( (GfxIsGPUBusy() == true) || (SystemIsBusy() == true) )
     {
         return;
@@ -101,7 +189,24 @@ void ISR_Serial(void)
         }
     }
 
-    GsSortGPoly4(&SerialBg);
+    if(bg_cached == false)
+    {
+        // Text is more important than background if running out of primitives.
+        GfxSetPrimitivePriority(GFX_PRIORITY_LOW);
+
+        GfxSortGPoly4(&SerialBg);
+
+        GfxSetPrimitivePriority(GFX_PRIORITY_NORMAL);
+
+        // Background is only drawn once. From now on, it is restored
+        // from VRAM only on areas where text must be redrawn.
+        GfxDirtyModeEnable();
+
+        bg_cached = true;
+        redraw_all = true;
+    }
+
+    GfxDirtyRect(0, SERIAL_STATE_TEXT_Y, X_SCREEN_RESOLUTION, SmallFont.char_h);
 
     switch(SerialState)
     {
@@ -127,6 +232,13 @@ void ISR_Serial(void)
 
         case SERIAL_STATE_READING_EXE_DATA:
             FontPrintText(&SmallFont, SERIAL_STATE_TEXT_X, SERIAL_STATE_TEXT_Y, "Reading PSX-EXE data (%d/%d bytes)...", exeBytesRead, ExeSize);
+
+            SerialUpdateThroughput();
+
+            GfxDirtyRect(0, SERIAL_THROUGHPUT_TEXT_Y, X_SCREEN_RESOLUTION, SmallFont.char_h);
+            FontPrintText(&SmallFont, SERIAL_STATE_TEXT_X, SERIAL_THROUGHPUT_TEXT_Y, "%d bytes/s, ETA %d s", fix16_to_int(bytes_per_second), eta_seconds);
+
+            LoadMenuDrawProgressBar((fix16_t)(progress >> 16));
         break;
 
         case SERIAL_STATE_WAITING_USER_INPUT:
@@ -136,6 +248,10 @@ void ISR_Serial(void)
         case SERIAL_STATE_CLEANING_MEMORY:
             FontPrintText(&SmallFont, SERIAL_STATE_TEXT_X, SERIAL_STATE_TEXT_Y, "Cleaning RAM before EXE data transfer...");
         break;
+
+        case SERIAL_STATE_SERVING_COMMAND:
+            FontPrintText(&SmallFont, SERIAL_STATE_TEXT_X, SERIAL_STATE_TEXT_Y, "Serving PC command...");
+        break;
         
         default:
             FontPrintText(&SmallFont, SERIAL_STATE_TEXT_X, SERIAL_STATE_TEXT_Y, "Unknown state");
@@ -144,26 +260,54 @@ void ISR_Serial(void)
 
     FontSetFlags(&SmallFont, FONT_H_CENTERED);
 
-    if(RAMDest_Address != 0)
+    if( (redraw_all == true) || (RAMDest_Address != shown_RAMDest_Address) )
     {
-        FontPrintText(&SmallFont, SERIAL_STATE_TEXT_X, SERIAL_STATE_TEXT_Y + 16, "RAM Dest address: 0x%08X", RAMDest_Address);
+        shown_RAMDest_Address = RAMDest_Address;
+        GfxDirtyRect(0, SERIAL_RAM_DEST_TEXT_Y, X_SCREEN_RESOLUTION, SmallFont.char_h);
+        FontPrintText(&SmallFont, SERIAL_STATE_TEXT_X, SERIAL_RAM_DEST_TEXT_Y, "RAM Dest address: 0x%08X", RAMDest_Address);
     }
 
-    if(initPC_Address != 0)
+    if( (redraw_all == true) || (initPC_Address != shown_initPC_Address) )
     {
-        FontPrintText(&SmallFont, SERIAL_STATE_TEXT_X, SERIAL_STATE_TEXT_Y + 32, "Init PC address: 0x%08X", initPC_Address);
+        shown_initPC_Address = initPC_Address;
+        GfxDirtyRect(0, SERIAL_INIT_PC_TEXT_Y, X_SCREEN_RESOLUTION, SmallFont.char_h);
+        FontPrintText(&SmallFont, SERIAL_STATE_TEXT_X, SERIAL_INIT_PC_TEXT_Y, "Init PC address: 0x%08X", initPC_Address);
     }
     
-    if(ExeSize != 0)
+    if( (redraw_all == true) || (ExeSize != shown_ExeSize) )
+    {
+        shown_ExeSize = ExeSize;
+        GfxDirtyRect(0, SERIAL_EXE_SIZE_TEXT_Y, X_SCREEN_RESOLUTION, SmallFont.char_h);
+        FontPrintText(&SmallFont, SERIAL_STATE_TEXT_X, SERIAL_EXE_SIZE_TEXT_Y, "PSX-EXE size: 0x%08X", ExeSize);
+    }
+
+#ifdef PSXSDK_DEBUG
+    // Stack high-water marks, for development only.
+    SystemGetStackStats(&stack_stats);
+
+    if( (redraw_all == true)
+                    ||
+        (stack_stats.main_used != shown_stack_used)
+                    ||
+        (stack_stats.isr_used != shown_isr_stack_used) )
     {
-        FontPrintText(&SmallFont, SERIAL_STATE_TEXT_X, SERIAL_STATE_TEXT_Y + 48, "PSX-EXE size: 0x%08X", ExeSize);
+        shown_stack_used = stack_stats.main_used;
+        shown_isr_stack_used = stack_stats.isr_used;
+        GfxDirtyRect(0, SERIAL_STACK_TEXT_Y, X_SCREEN_RESOLUTION, SmallFont.char_h);
+        FontPrintText(  &SmallFont, SERIAL_STATE_TEXT_X, SERIAL_STACK_TEXT_Y, "Stack: %d/%d bytes, ISR: %d/%d bytes%s",
+                        stack_stats.main_used, stack_stats.main_size,
+                        stack_stats.isr_used, stack_stats.isr_size,
+                        (stack_stats.overflow != 0)? " (overflow!)" : ""  );
     }
+#endif // PSXSDK_DEBUG
 
     GfxDrawScene_Fast();
 }
 
 void SerialSetState(SERIAL_STATE state)
 {
+    TRACE_INSTANT(TRACE_EVENT_SERIAL_STATE, state);
+
     SerialState = state;
 }
 
@@ -180,6 +324,70 @@ void SerialSetRAMDestAddress(uint32_t addr)
 void SerialSetExeSize(size_t size)
 {
     ExeSize = size;
+
+    progress = 0;
+    progress_step = (size != 0)? (0xFFFFFFFF / size) : 0;
+
+    rate_timestamp = SystemGetTimestamp();
+    rate_bytes = 0;
+    bytes_per_second = 0;
+    eta_seconds = 0;
+}
+
+/* *******************************************************************
+ *
+ * @name: static void SerialUpdateThroughput(void)
+ *
+ * @brief:
+ * 	Calculates received bytes per second since last call and
+ * 	estimated time left for transfer to finish.
+ *
+ * @remarks:
+ * 	Called from ISR_Serial() once per second, so divisions are
+ * 	kept out of reception loop.
+ *
+ * *******************************************************************/
+
+static void SerialUpdateThroughput(void)
+{
+    uint32_t now = SystemGetTimestamp();
+    uint32_t ticks = now - rate_timestamp;
+    size_t bytes = exeBytesRead - rate_bytes;
+    fix16_t seconds;
+    fix16_t sample;
+    int32_t rate;
+
+    if(ticks == 0)
+    {
+        return;
+    }
+
+    rate_timestamp = now;
+    rate_bytes = exeBytesRead;
+
+    // Keep both values inside fix16_t integer range.
+    while( (ticks > SERIAL_FIX16_MAX_INT) || (bytes > SERIAL_FIX16_MAX_INT) )
+    {
+        ticks >>= 1;
+        bytes >>= 1;
+    }
+
+    seconds = fix16_sdiv(fix16_from_int(ticks), fix16_from_int(SYSTEM_TIMESTAMP_FREQUENCY));
+    sample = fix16_sdiv(fix16_from_int(bytes), seconds);
+
+    if(bytes_per_second == 0)
+    {
+        bytes_per_second = sample;
+    }
+    else
+    {
+        // Smooth out readout: new = old + (sample - old) / 4
+        bytes_per_second += (sample - bytes_per_second) >> 2;
+    }
+
+    rate = fix16_to_int(bytes_per_second);
+
+    eta_seconds = (rate > 0)? ((ExeSize - exeBytesRead) / rate) : 0;
 }
 
 void SerialInit(void)
@@ -192,6 +400,11 @@ void SerialInit(void)
 
     SIOStart(SERIAL_BAUDRATE);
 
+    ChannelInit();
+
+    // Keep receiving bytes while waiting for GPU.
+    GfxSetIdleCallback(&SerialPoll);
+
     SerialState = SERIAL_STATE_STANDBY;
 
     // ------------------------------------
@@ -199,14 +412,73 @@ void SerialInit(void)
     // ------------------------------------
 
     // 1. Wait to receive magic byte "99" from PC.
+    //    Any other command received meanwhile is served
+    //    and then we keep waiting for the magic byte.
 
-    SerialRead(&receivedBytes, sizeof(uint8_t) );
-
-    if(receivedBytes != 99)
+    do
     {
-        dprintf("Did not receive input magic number!\n");
-        return;
-    }
+        SerialRead(&receivedBytes, sizeof(uint8_t) );
+
+        switch(receivedBytes)
+        {
+            case SERIAL_MAGIC_UPLOAD:
+            break;
+
+            case SERIAL_MAGIC_UPLOAD_INSTANT:
+                instant_exec = true;
+                receivedBytes = SERIAL_MAGIC_UPLOAD;
+            break;
+
+            case SERIAL_MAGIC_UPLOAD_RESIDENT:
+                resident_exec = true;
+                receivedBytes = SERIAL_MAGIC_UPLOAD;
+            break;
+
+            case SERIAL_CMD_GFX_STATS:
+                SerialSendGfxStats();
+            break;
+
+            case SERIAL_CMD_BOOT_PROFILE:
+                SerialSendBootProfile();
+            break;
+
+            case SERIAL_CMD_IRQ_STATS:
+                SerialSendIrqStats();
+            break;
+
+            case SERIAL_CMD_STACK_STATS:
+                SerialSendStackStats();
+            break;
+
+            case SERIAL_CMD_MEM_READ:
+                // Fall through.
+            case SERIAL_CMD_MEM_WRITE:
+                // Fall through.
+            case SERIAL_CMD_MEM_FILL:
+                // Fall through.
+            case SERIAL_CMD_MEM_HASH:
+                SerialState = SERIAL_STATE_SERVING_COMMAND;
+                SerialServeMemoryCommand(receivedBytes);
+            break;
+
+            case SERIAL_CMD_VRAM_CAPTURE:
+                SerialState = SERIAL_STATE_SERVING_COMMAND;
+                SerialSendVRAMCapture();
+            break;
+
+            case SERIAL_CMD_TRACE_DUMP:
+                SerialState = SERIAL_STATE_SERVING_COMMAND;
+                SerialSendTrace();
+            break;
+
+            default:
+                dprintf("Did not receive input magic number!\n");
+            break;
+        }
+
+        SerialState = SERIAL_STATE_STANDBY;
+
+    }while(receivedBytes != SERIAL_MAGIC_UPLOAD);
 
     // 2. Send ACK (magic byte is ASCII code for 'b').
 
@@ -215,9 +487,562 @@ void SerialInit(void)
     SerialWrite(ACK_BYTE_STRING, sizeof(uint8_t) );
 }
 
+/* *******************************************************************
+ *
+ * @name: void SerialSendGfxStats(void)
+ *
+ * @brief:
+ * 	Sends primitive list usage statistics to PC, as a
+ * 	TYPE_PRIM_LIST_STATS structure (little-endian 32-bit words).
+ *
+ * *******************************************************************/
+
+void SerialSendGfxStats(void)
+{
+    TYPE_PRIM_LIST_STATS stats;
+
+    GfxGetPrimitiveListStats(&stats);
+
+    SerialWriteFramed(CHANNEL_CONTROL, &stats, sizeof(TYPE_PRIM_LIST_STATS));
+}
+
+/* *******************************************************************
+ *
+ * @name: void SerialSendBootProfile(void)
+ *
+ * @brief:
+ * 	Sends boot profile to PC: number of steps and timestamp
+ * 	frequency (32-bit words), followed by a TYPE_BOOT_STEP
+ * 	structure for each step.
+ *
+ * *******************************************************************/
+
+void SerialSendBootProfile(void)
+{
+    uint32_t header[2];
+    const TYPE_BOOT_STEP* steps;
+    uint8_t nSteps;
+
+    steps = SystemGetBootProfile(&nSteps);
+
+    header[0] = nSteps;
+    header[1] = SYSTEM_TIMESTAMP_FREQUENCY;
+
+    SerialWriteFramed(CHANNEL_CONTROL, header, sizeof(header));
+    SerialWriteFramed(CHANNEL_CONTROL, steps, nSteps * sizeof(TYPE_BOOT_STEP));
+}
+
+/* *******************************************************************
+ *
+ * @name: void SerialSendIrqStats(void)
+ *
+ * @brief:
+ * 	Sends interrupt latency and masked time histograms to PC, as a
+ * 	TYPE_IRQ_STATS structure (little-endian 32-bit words).
+ *
+ * *******************************************************************/
+
+void SerialSendIrqStats(void)
+{
+    TYPE_IRQ_STATS stats;
+
+    IrqStatsGet(&stats);
+
+    SerialWriteFramed(CHANNEL_CONTROL, &stats, sizeof(TYPE_IRQ_STATS));
+}
+
+/* *******************************************************************
+ *
+ * @name: void SerialSendStackStats(void)
+ *
+ * @brief:
+ * 	Sends stack high-water marks to PC, as a TYPE_STACK_STATS
+ * 	structure (little-endian 32-bit words).
+ *
+ * *******************************************************************/
+
+void SerialSendStackStats(void)
+{
+    TYPE_STACK_STATS stats;
+
+    SystemGetStackStats(&stats);
+
+    SerialWriteFramed(CHANNEL_CONTROL, &stats, sizeof(TYPE_STACK_STATS));
+}
+
+/* *******************************************************************
+ *
+ * @name: void SerialServeMemoryCommand(uint8_t cmd)
+ *
+ * @brief:
+ * 	Serves a memory access command from PC. All commands are
+ * 	followed by address and size (little-endian 32-bit words):
+ *
+ * 	*	SERIAL_CMD_MEM_READ: PSX sends data through CHANNEL_BULK in
+ * 		SERIAL_MEM_BLOCK_SIZE blocks, each one followed by its
+ * 		Adler-32 checksum. PC answers ACK to get next block or NACK
+ * 		to get it again.
+ * 	*	SERIAL_CMD_MEM_WRITE: same as above, but PC sends blocks
+ * 		and PSX answers.
+ * 	*	SERIAL_CMD_MEM_FILL: a third word follows, whose lowest byte
+ * 		is written to the whole range. PSX answers ACK when done.
+ * 	*	SERIAL_CMD_MEM_HASH: PSX answers Adler-32 of the whole range.
+ *
+ * 	Other replies go through CHANNEL_CONTROL. Invalid ranges are
+ * 	answered with a single NACK byte.
+ *
+ * @remarks:
+ * 	Writing over the loader itself is not prevented.
+ *
+ * *******************************************************************/
+
+void SerialServeMemoryCommand(uint8_t cmd)
+{
+    uint32_t address;
+    uint32_t size;
+    uint32_t value;
+
+    if( (SerialReadWord(&address) == false) || (SerialReadWord(&size) == false) )
+    {
+        return;
+    }
+
+    if( (cmd == SERIAL_CMD_MEM_FILL) && (SerialReadWord(&value) == false) )
+    {
+        return;
+    }
+
+    if(SerialIsValidRange(address, size, (cmd == SERIAL_CMD_MEM_WRITE) || (cmd == SERIAL_CMD_MEM_FILL)) == false)
+    {
+        dprintf("Invalid memory range 0x%08X, %d bytes\n", address, size);
+        SerialWriteFramed(CHANNEL_CONTROL, NACK_BYTE_STRING, sizeof(uint8_t));
+        return;
+    }
+
+    SerialWriteFramed(CHANNEL_CONTROL, ACK_BYTE_STRING, sizeof(uint8_t));
+
+    switch(cmd)
+    {
+        case SERIAL_CMD_MEM_READ:
+            SerialMemRead((uint8_t*)address, size);
+        break;
+
+        case SERIAL_CMD_MEM_WRITE:
+            SerialMemWrite((uint8_t*)address, size);
+        break;
+
+        case SERIAL_CMD_MEM_FILL:
+            memset((void*)address, (uint8_t)value, size);
+            SerialWriteFramed(CHANNEL_CONTROL, ACK_BYTE_STRING, sizeof(uint8_t));
+        break;
+
+        case SERIAL_CMD_MEM_HASH:
+            value = SystemAdler32(1, (uint8_t*)address, size);
+            SerialWriteFramed(CHANNEL_CONTROL, &value, sizeof(uint32_t));
+        break;
+
+        default:
+        break;
+    }
+}
+
+static bool SerialMemRead(uint8_t* address, uint32_t size)
+{
+    while(size != 0)
+    {
+        uint32_t block = (size > SERIAL_MEM_BLOCK_SIZE)? SERIAL_MEM_BLOCK_SIZE : size;
+
+        if(SerialSendBlock(address, block) == false)
+        {
+            return false;
+        }
+
+        address += block;
+        size -= block;
+    }
+
+    return true;
+}
+
+/* *******************************************************************
+ *
+ * @name: static bool SerialSendBlock(const uint8_t* data, uint32_t size)
+ *
+ * @brief:
+ * 	Sends a block and its Adler-32 checksum through CHANNEL_BULK,
+ * 	until PC answers ACK. Returns false if PC aborted transfer by
+ * 	answering anything else than ACK or NACK, or did not answer.
+ *
+ * *******************************************************************/
+
+static bool SerialSendBlock(const uint8_t* data, uint32_t size)
+{
+    uint32_t checksum = SystemAdler32(1, data, size);
+
+    while(1)
+    {
+        uint8_t answer;
+
+        SerialWriteFramed(CHANNEL_BULK, data, size);
+        SerialWriteFramed(CHANNEL_BULK, &checksum, sizeof(uint32_t));
+
+        if(SerialRead(&answer, sizeof(uint8_t)) == false)
+        {
+            return false;
+        }
+
+        if(answer == ACK_BYTE_STRING[0])
+        {
+            return true;
+        }
+        else if(answer != NACK_BYTE_STRING[0])
+        {
+            // PC aborted transfer.
+            return false;
+        }
+    }
+}
+
+/* *******************************************************************
+ *
+ * @name: static bool SerialBlockWrite(const void* data, size_t n)
+ *
+ * @brief:
+ * 	Streams data from several places as if it was a single memory
+ * 	range read by SERIAL_CMD_MEM_READ, so PC always gets whole
+ * 	SERIAL_MEM_BLOCK_SIZE blocks, no matter how data was split.
+ * 	Last block is sent by SerialBlockFlush().
+ *
+ * *******************************************************************/
+
+static bool SerialBlockWrite(const void* data, size_t n)
+{
+    const uint8_t* src = data;
+
+    while(n != 0)
+    {
+        size_t copy = SERIAL_MEM_BLOCK_SIZE - block_used;
+
+        if(copy > n)
+        {
+            copy = n;
+        }
+
+        memcpy(&block_buffer[block_used], src, copy);
+        block_used += copy;
+        src += copy;
+        n -= copy;
+
+        if(block_used == SERIAL_MEM_BLOCK_SIZE)
+        {
+            block_used = 0;
+
+            if(SerialSendBlock(block_buffer, SERIAL_MEM_BLOCK_SIZE) == false)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool SerialBlockFlush(void)
+{
+    size_t n = block_used;
+
+    block_used = 0;
+
+    return (n == 0) || SerialSendBlock(block_buffer, n);
+}
+
+static void SerialMemWrite(uint8_t* address, uint32_t size)
+{
+    static uint8_t buffer[SERIAL_MEM_BLOCK_SIZE];
+
+    while(size != 0)
+    {
+        uint32_t block = (size > SERIAL_MEM_BLOCK_SIZE)? SERIAL_MEM_BLOCK_SIZE : size;
+        uint32_t checksum;
+
+        // Data is only copied to destination once checksum is right.
+        if( (SerialRead(buffer, block) == false) || (SerialReadWord(&checksum) == false) )
+        {
+            return;
+        }
+
+        if(SystemAdler32(1, buffer, block) == checksum)
+        {
+            memcpy(address, buffer, block);
+            address += block;
+            size -= block;
+            SerialWriteFramed(CHANNEL_CONTROL, ACK_BYTE_STRING, sizeof(uint8_t));
+        }
+        else
+        {
+            SerialWriteFramed(CHANNEL_CONTROL, NACK_BYTE_STRING, sizeof(uint8_t));
+        }
+    }
+}
+
+/* *******************************************************************
+ *
+ * @name: void SerialSendVRAMCapture(void)
+ *
+ * @brief:
+ * 	Sends a VRAM rectangle to PC. PC sends X, Y, W and H as
+ * 	little-endian 16-bit words (W = 0 means displayed framebuffer),
+ * 	and PSX answers ACK followed by the rectangle actually captured
+ * 	(same format), or NACK if rectangle is not valid.
+ *
+ * 	Rectangle is then sent through CHANNEL_BULK as 16-bit pixels,
+ * 	row by row, as if it was a memory range read by
+ * 	SERIAL_CMD_MEM_READ (see Tools/SerialDump.c).
+ *
+ * @remarks:
+ * 	Next chunk is copied from VRAM by DMA while current chunk is
+ * 	being sent.
+ *
+ * *******************************************************************/
+
+void SerialSendVRAMCapture(void)
+{
+    MEMORY_MARK mark = MemoryGetMark();
+    uint16_t* chunk[2];
+    uint8_t params[4 * sizeof(uint16_t)];
+    short x;
+    short y;
+    short w;
+    short h;
+    short row;
+    short rows_per_chunk;
+    uint8_t index = 0;
+
+    if(SerialRead(params, sizeof(params)) == false)
+    {
+        return;
+    }
+
+    x = params[0] | (params[1] << 8);
+    y = params[2] | (params[3] << 8);
+    w = params[4] | (params[5] << 8);
+    h = params[6] | (params[7] << 8);
+
+    if(w == 0)
+    {
+        GfxGetDisplayPosition(&x, &y);
+        w = X_SCREEN_RESOLUTION;
+        h = Y_SCREEN_RESOLUTION;
+    }
+
+    chunk[0] = MemoryAlloc(SERIAL_VRAM_CHUNK_SIZE);
+    chunk[1] = MemoryAlloc(SERIAL_VRAM_CHUNK_SIZE);
+
+    rows_per_chunk = (w > 0)? (SERIAL_VRAM_CHUNK_SIZE / (w * sizeof(uint16_t))) : 0;
+
+    if(	(chunk[0] == NULL) || (chunk[1] == NULL) || (rows_per_chunk == 0)
+                    ||
+        (GfxStoreImage(chunk[0], x, y, w, (h < rows_per_chunk)? h : rows_per_chunk) == false) )
+    {
+        SerialWriteFramed(CHANNEL_CONTROL, NACK_BYTE_STRING, sizeof(uint8_t));
+        MemoryRelease(mark);
+        return;
+    }
+
+    GfxWaitStoreImage();
+
+    params[0] = (uint8_t)x;
+    params[1] = (uint8_t)(x >> 8);
+    params[2] = (uint8_t)y;
+    params[3] = (uint8_t)(y >> 8);
+    params[4] = (uint8_t)w;
+    params[5] = (uint8_t)(w >> 8);
+    params[6] = (uint8_t)h;
+    params[7] = (uint8_t)(h >> 8);
+
+    SerialWriteFramed(CHANNEL_CONTROL, ACK_BYTE_STRING, sizeof(uint8_t));
+    SerialWriteFramed(CHANNEL_CONTROL, params, sizeof(params));
+
+    block_used = 0;
+
+    for(row = 0; row < h; row += rows_per_chunk)
+    {
+        short rows = (h - row > rows_per_chunk)? rows_per_chunk : (h - row);
+        bool pending = (row + rows) < h;
+        bool sent;
+
+        if(pending == true)
+        {
+            short next_rows = h - row - rows;
+
+            if(next_rows > rows_per_chunk)
+            {
+                next_rows = rows_per_chunk;
+            }
+
+            // Next chunk is read from VRAM while this one is sent.
+            GfxStoreImage(chunk[index ^ 1], x, y + row + rows, w, next_rows);
+        }
+
+        // Chunks are not block-aligned, so they are streamed.
+        sent = SerialBlockWrite(chunk[index], rows * w * sizeof(uint16_t));
+
+        if(pending == true)
+        {
+            GfxWaitStoreImage();
+        }
+
+        if(sent == false)
+        {
+            break;
+        }
+
+        index ^= 1;
+    }
+
+    if(row >= h)
+    {
+        SerialBlockFlush();
+    }
+
+    MemoryRelease(mark);
+}
+
+/* *******************************************************************
+ *
+ * @name: void SerialSendTrace(void)
+ *
+ * @brief:
+ * 	Sends event trace to PC through CHANNEL_BULK: number of records
+ * 	and timestamp frequency (32-bit words), followed by
+ * 	TYPE_TRACE_RECORD structures, oldest first, in
+ * 	SERIAL_MEM_BLOCK_SIZE blocks as described for SERIAL_CMD_MEM_READ.
+ * 	Records are sent as a single range even if trace ring wrapped,
+ * 	so only last block is shorter. Recording is paused meanwhile.
+ *
+ * *******************************************************************/
+
+void SerialSendTrace(void)
+{
+    const TYPE_TRACE_RECORD* first;
+    const TYPE_TRACE_RECORD* second;
+    uint32_t header[2];
+    size_t n1;
+    size_t n2;
+
+    TraceSetEnabled(false);
+
+    TraceGetRecords(&first, &n1, &second, &n2);
+
+    header[0] = n1 + n2;
+    header[1] = SYSTEM_TIMESTAMP_FREQUENCY;
+
+    SerialWriteFramed(CHANNEL_BULK, header, sizeof(header));
+
+    block_used = 0;
+
+    if(	(SerialBlockWrite(first, n1 * sizeof(TYPE_TRACE_RECORD)) == true)
+                    &&
+        (SerialBlockWrite(second, n2 * sizeof(TYPE_TRACE_RECORD)) == true) )
+    {
+        SerialBlockFlush();
+    }
+
+    TraceSetEnabled(true);
+}
+
+static bool SerialReadWord(uint32_t* word)
+{
+    uint8_t data[sizeof(uint32_t)];
+
+    if(SerialRead(data, sizeof(data)) == false)
+    {
+        return false;
+    }
+
+    *word = data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
+
+    return true;
+}
+
+/* *******************************************************************
+ *
+ * @name: static bool SerialIsValidRange(uint32_t address, uint32_t size, bool write)
+ *
+ * @brief:
+ * 	Checks whether range lies inside main RAM (KUSEG, KSEG0 or
+ * 	KSEG1), scratchpad (KUSEG or KSEG0, since it is not mapped
+ * 	on KSEG1) or, for reading only, BIOS ROM. Accessing other
+ * 	areas could cause a bus error.
+ *
+ * *******************************************************************/
+
+static bool SerialIsValidRange(uint32_t address, uint32_t size, bool write)
+{
+    enum
+    {
+        RAM_SIZE = 0x200000,
+        SCRATCHPAD_ADDRESS = 0x1F800000,
+        SCRATCHPAD_SIZE = 0x400,
+        BIOS_ADDRESS = 0xBFC00000,
+        BIOS_SIZE = 0x80000,
+        SEGMENT_MASK = 0x1FFFFFFF,
+        SEGMENT_SHIFT = 29,
+        SEGMENT_KUSEG = 0,
+        SEGMENT_KSEG0 = 4,
+        SEGMENT_KSEG1 = 5
+    };
+
+    uint32_t physical = address & SEGMENT_MASK;
+    uint32_t segment = address >> SEGMENT_SHIFT;
+
+    if( (size == 0) || ((address + size) < address) )
+    {
+        return false;
+    }
+
+    if(	((segment == SEGMENT_KUSEG) || (segment == SEGMENT_KSEG0) || (segment == SEGMENT_KSEG1))
+            &&
+        ((physical + size) <= RAM_SIZE) )
+    {
+        return true;
+    }
+
+    if(	((segment == SEGMENT_KUSEG) || (segment == SEGMENT_KSEG0))
+            &&
+        (physical >= SCRATCHPAD_ADDRESS)
+            &&
+        ((physical + size) <= (SCRATCHPAD_ADDRESS + SCRATCHPAD_SIZE)) )
+    {
+        return true;
+    }
+
+    if(	(write == false)
+            &&
+        (address >= BIOS_ADDRESS)
+            &&
+        ((address + size) <= (BIOS_ADDRESS + BIOS_SIZE)) )
+    {
+        return true;
+    }
+
+    return false;
+}
+
+bool SerialIsInstantExecRequested(void)
+{
+    return instant_exec;
+}
+
+bool SerialIsResidentExecRequested(void)
+{
+    return resident_exec;
+}
+
 void SerialSetExeBytesReceived(uint32_t bytes_read)
 {
     exeBytesRead += bytes_read;
+    progress += bytes_read * progress_step;
 }
 
 bool SerialRead(uint8_t* ptrArray, size_t nBytes)
@@ -237,9 +1062,21 @@ bool SerialRead(uint8_t* ptrArray, size_t nBytes)
     {
         //uint16_t timeout = SERIAL_TX_RX_TIMEOUT;
         
-        while( (SIOCheckInBuffer() == SERIAL_RX_FIFO_EMPTY)); // Wait for RX FIFO not empty
+        if(rx_head != rx_tail)
+        {
+            // Get bytes received in the background first.
+            *(ptrArray++) = rx_buffer[rx_tail];
+            rx_tail = (rx_tail + 1) & (SERIAL_RX_BUFFER_SIZE - 1);
+        }
+        else
+        {
+            while( (SIOCheckInBuffer() == SERIAL_RX_FIFO_EMPTY)); // Wait for RX FIFO not empty
+
+            *(ptrArray++) = SIOReadByte();
+
+            SerialCheckOverrun();
+        }
 
-        *(ptrArray++) = SIOReadByte();
         bytesRead++;
     }while(--nBytes);
 
@@ -248,6 +1085,90 @@ bool SerialRead(uint8_t* ptrArray, size_t nBytes)
     return true;
 }
 
+/* *******************************************************************
+ *
+ * @name: void SerialPoll(void)
+ *
+ * @brief:
+ * 	Moves all bytes available on SIO RX FIFO into internal buffer,
+ * 	where SerialRead() will get them from later.
+ *
+ * @remarks:
+ * 	Used as GPU idle callback, so no bytes are lost while waiting
+ * 	for GPU. Not to be called from ISR.
+ *
+ * *******************************************************************/
+
+void SerialPoll(void)
+{
+    while(SIOCheckInBuffer() != SERIAL_RX_FIFO_EMPTY)
+    {
+        uint8_t next_head = (rx_head + 1) & (SERIAL_RX_BUFFER_SIZE - 1);
+
+        if(next_head == rx_tail)
+        {
+            // Buffer full. Remaining bytes stay in RX FIFO.
+            break;
+        }
+
+        rx_buffer[rx_head] = SIOReadByte();
+        rx_head = next_head;
+    }
+
+    SerialCheckOverrun();
+}
+
+// Counts bytes lost because RX FIFO was not emptied on time.
+static void SerialCheckOverrun(void)
+{
+    if(SIO_STAT & SIO_STAT_RX_OVERRUN)
+    {
+        IrqStatsCountSioOverrun();
+        SIO_CTRL |= SIO_CTRL_ACK;
+    }
+}
+
+/* *******************************************************************
+ *
+ * @name: static bool SerialWriteFramed(CHANNEL_ID ch, const void* data, size_t n)
+ *
+ * @brief:
+ * 	Sends "data" through channel "ch" (see Channel.h), in frames of
+ * 	up to CHANNEL_MAX_PAYLOAD bytes. Blocking, like SerialWrite().
+ *
+ * @remarks:
+ * 	Loader does not use SIO TX interrupt, so frames are sent here by
+ * 	polling. Channel is empty on return, so data is never dropped.
+ *
+ * *******************************************************************/
+
+static bool SerialWriteFramed(CHANNEL_ID ch, const void* data, size_t n)
+{
+    const uint8_t* src = data;
+    bool queued = true;
+
+    serial_busy = true;
+
+    SystemDisableVBlankInterrupt();
+
+    while( (n != 0) && (queued == true) )
+    {
+        size_t chunk = (n > CHANNEL_MAX_PAYLOAD)? CHANNEL_MAX_PAYLOAD : n;
+
+        queued = ChannelWrite(ch, src, chunk);
+        ChannelFlush(ch);
+
+        src += chunk;
+        n -= chunk;
+    }
+
+    SystemEnableVBlankInterrupt(__builtin_return_address(0));
+
+    serial_busy = false;
+
+    return queued;
+}
+
 bool SerialWrite(void* ptrArray, size_t nBytes)
 {
     serial_busy = true;
@@ -270,7 +1191,8 @@ bool SerialWrite(void* ptrArray, size_t nBytes)
 
     }while(--nBytes);
 
-    SystemEnableVBlankInterrupt();
+    // Blames caller of SerialWrite(), not SerialWrite() itself.
+    SystemEnableVBlankInterrupt(__builtin_return_address(0));
 
     serial_busy = false;
 
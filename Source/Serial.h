@@ -9,13 +9,49 @@
 #include "System.h"
 #include "Gfx.h"
 #include "Font.h"
+#include "LoadMenu.h"
+#include "Channel.h"
 
 /* *************************************
  * 	Defines
  * *************************************/
 
+#define SERIAL_BAUDRATE 115200
+// Start bit, 8 data bits and stop bit per byte.
+#define SERIAL_BYTES_PER_SECOND (SERIAL_BAUDRATE / 10)
+
 #define ACK_BYTE_STRING "b"
 
+// Commands accepted from PC while in SERIAL_STATE_STANDBY. PC sends
+// raw bytes, but PSX replies to commands other than uploads are
+// framed (see Channel.h): short replies, ACK and NACK go through
+// CHANNEL_CONTROL and memory, VRAM and trace data through CHANNEL_BULK.
+#define SERIAL_MAGIC_UPLOAD 99
+// Same as SERIAL_MAGIC_UPLOAD, but PSX-EXE runs without end animation.
+#define SERIAL_MAGIC_UPLOAD_INSTANT 'i'
+// Same as SERIAL_MAGIC_UPLOAD, but OpenSend stays resident, so PC can
+// stop PSX-EXE later by sending RESIDENT_MAGIC_RETURN.
+#define SERIAL_MAGIC_UPLOAD_RESIDENT 'R'
+#define SERIAL_CMD_GFX_STATS 'g'
+#define SERIAL_CMD_BOOT_PROFILE 'p'
+// Interrupt latency histograms. See SerialSendIrqStats().
+#define SERIAL_CMD_IRQ_STATS 'l'
+// Stack high-water marks. See SerialSendStackStats().
+#define SERIAL_CMD_STACK_STATS 's'
+// Memory access commands. See SerialServeMemoryCommand().
+#define SERIAL_CMD_MEM_READ 'r'
+#define SERIAL_CMD_MEM_WRITE 'w'
+#define SERIAL_CMD_MEM_FILL 'f'
+#define SERIAL_CMD_MEM_HASH 'h'
+
+// VRAM rectangle capture. See SerialSendVRAMCapture().
+#define SERIAL_CMD_VRAM_CAPTURE 'v'
+
+// Event trace dump. See SerialSendTrace().
+#define SERIAL_CMD_TRACE_DUMP 'T'
+
+#define NACK_BYTE_STRING "n"
+
 /* **************************************
  * 	Structs and enums					*
  * *************************************/
@@ -30,6 +66,7 @@ typedef enum
     SERIAL_STATE_READING_EXE_DATA,
     SERIAL_STATE_WAITING_USER_INPUT,
     SERIAL_STATE_CLEANING_MEMORY,
+    SERIAL_STATE_SERVING_COMMAND,
 }SERIAL_STATE;
 
 /* *************************************
@@ -45,5 +82,15 @@ void SerialSetPCAddress(uint32_t addr);
 void SerialSetRAMDestAddress(uint32_t addr);
 void SerialSetExeSize(size_t size);
 void SerialSetExeBytesReceived(uint32_t bytes_read);
+void SerialSendGfxStats(void);
+void SerialSendBootProfile(void);
+void SerialSendIrqStats(void);
+void SerialSendStackStats(void);
+void SerialServeMemoryCommand(uint8_t cmd);
+void SerialSendVRAMCapture(void);
+void SerialSendTrace(void);
+void SerialPoll(void);
+bool SerialIsInstantExecRequested(void);
+bool SerialIsResidentExecRequested(void);
 
 #endif // __SERIAL_HEADER__
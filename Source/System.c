@@ -9,24 +9,45 @@
  * *************************************/
  
 #define SYSTEM_MAX_TIMERS 16
-#define FILE_BUFFER_SIZE 0xC40
 #define END_STACK_PATTERN (uint32_t) 0x18022015
-#define BEGIN_STACK_ADDRESS (uint32_t*) 0x801FFF00
-#define STACK_SIZE 0x1000
+#define BEGIN_STACK_ADDRESS (uint32_t*) SYSTEM_STACK_TOP
+#define STACK_SIZE SYSTEM_STACK_SIZE
+#define STACK_BOTTOM_ADDRESS ((uint32_t*)(SYSTEM_STACK_TOP - SYSTEM_STACK_SIZE))
+// Bytes left unpainted below SystemStackPaint() local variables,
+// so that its own stack frame is not overwritten.
+#define STACK_PAINT_MARGIN 64
+// Stack owned by loader for VBlank ISR. See SystemCallOnIsrStack.
+#define ISR_STACK_SIZE 0x1000
+// Argument save area required by MIPS calling convention, followed
+// by previous $sp and $ra, at the top of ISR stack.
+#define ISR_STACK_FRAME_SIZE 24
+#define SYSTEM_STRINGIFY_(x) #x
+#define SYSTEM_STRINGIFY(x) SYSTEM_STRINGIFY_(x)
+#define I_STAT (*(volatile unsigned int*)0x1F801070)
 #define I_MASK (*(volatile unsigned int*)0x1F801074)
+#define I_MASK_VBLANK (1<<0)
+// COP0 status register, interrupt enable bit.
+#define COP0_SR_IEC (1<<0)
+#define RCNT1_COUNT (*(volatile unsigned int*)0x1F801110)
+#define RCNT1_MODE (*(volatile unsigned int*)0x1F801114)
+#define RCNT1_HBLANK_SOURCE (1<<8)
+// Set when counter wraps, cleared when mode register is read.
+#define RCNT1_REACHED_FFFF (1<<12)
+#define SYSTEM_ADLER32_MOD 65521
 
 /* *************************************
  * 	Local Prototypes
  * *************************************/
 
 static void SystemSetStackPattern(void);
+static void ISR_SystemBootVBlank(void);
+static uint32_t* SystemStackPaint(uint32_t* bottom) __attribute__((noinline));
+static size_t SystemStackUnused(const uint32_t* bottom, const uint32_t* top);
 
 /* *************************************
  * 	Local Variables
  * *************************************/
 
-//Buffer to store any kind of files. It supports files up to 128 kB
-static uint8_t file_buffer[FILE_BUFFER_SIZE];
 //Global timer (called by interrupt)
 static volatile uint64_t global_timer;
 //Tells whether rand seed has been set
@@ -37,6 +58,21 @@ static volatile bool refresh_needed;
 static bool one_second_timer;
 //Critical section is entered (i.e.: when accessing fopen() or other BIOS functions
 static volatile bool system_busy;
+// Stack usage
+static TYPE_STACK_STATS stack_stats;
+// Used from SystemCallOnIsrStack, so it is not static.
+uint32_t SystemIsrStack[ISR_STACK_SIZE >> 2] __attribute__((aligned(8)));
+//Upper 16 bits for root counter 1 timestamps and last value read from it
+static uint32_t timestamp_high;
+static uint16_t timestamp_last;
+//File to be prefetched from CD-ROM once current file has been read
+static char* next_file;
+//Boot profile: duration of each init step
+static TYPE_BOOT_STEP boot_steps[SYSTEM_MAX_BOOT_STEPS];
+static uint8_t boot_steps_count;
+static uint32_t boot_last_timestamp;
+//Set once counter wraps are seen by ISR_SystemBootVBlank()
+static bool boot_wraps_tracked;
 
 /* *******************************************************************
  * 
@@ -52,30 +88,46 @@ static volatile bool system_busy;
 
 void SystemInit(void)
 {
+	//Start timestamp counter, used for boot profile
+	SystemInitTimestamp();
 	//Reset global timer
 	global_timer = 0;
 	//Reset 1 second timer
 	one_second_timer = 0;
-	//PSXSDK init
-	PSX_InitEx(PSX_INIT_SAVESTATE | PSX_INIT_CD);
+	//PSXSDK init. CD-ROM is only set up once a file is read (see CdRomInit())
+	PSX_InitEx(PSX_INIT_SAVESTATE);
+	SystemBootProfileMark("PSX_InitEx");
+	//Keep timestamp extended while booting
+	SetVBlankHandler(&ISR_SystemBootVBlank);
+	boot_wraps_tracked = true;
+	//Keep reading from CD-ROM while waiting for GPU
+	GfxSetIdleCallback(&CdRomPoll);
 	//Graphics init
 	GsInit();
+	SystemBootProfileMark("GsInit");
 	//Clear VRAM
 	GsClearMem();
+	SystemBootProfileMark("GsClearMem");
 	//Set Video Resolution
 #ifdef _PAL_MODE_
 	GsSetVideoMode(X_SCREEN_RESOLUTION, Y_SCREEN_RESOLUTION, VMODE_PAL);
 #else
 	GsSetVideoMode(X_SCREEN_RESOLUTION, Y_SCREEN_RESOLUTION, VMODE_NTSC);
 #endif //_PAL_MODE_
-	//SPU init
+	SystemBootProfileMark("GsSetVideoMode");
+#ifndef _LEAN_BOOT_
+	//SPU init. Loader plays no sound, so it is skipped on lean boot.
 	SsInit();
+	SystemBootProfileMark("SsInit");
+#endif // _LEAN_BOOT_
 	//Set Drawing Environment
 	GfxInitDrawEnv();
 	//Set Display Environment
 	GfxInitDispEnv();
 	//Set Primitive List
 	GfxSetPrimitiveList();
+	GfxSetPrimitivePriority(GFX_PRIORITY_NORMAL);
+	SystemBootProfileMark("GfxInit");
 	//Initial value for system_busy
 	system_busy = false;
 	
@@ -84,11 +136,6 @@ void SystemInit(void)
 	SystemSetStackPattern();
 }
 
-size_t SystemGetBufferSize(void)
-{
-    return sizeof(file_buffer);
-}
-
 /* *******************************************************************
  * 
  * @name: void SystemInit(void)
@@ -176,6 +223,14 @@ void ISR_SystemDefaultVBlank(void)
 {
 	refresh_needed = true;
 	SystemIncreaseGlobalTimer();
+	GfxFenceHandler();
+}
+
+// Installed until SerialInit(). No other ISR runs meanwhile, so root
+// counter 1 wraps would be missed by long boot steps otherwise.
+static void ISR_SystemBootVBlank(void)
+{
+	SystemGetTimestamp();
 }
 
 /* *******************************************************************
@@ -212,6 +267,262 @@ uint64_t SystemGetGlobalTimer(void)
 	return global_timer;
 }
 
+// Adler-32: fast to compute on the CPU and needs no lookup table.
+uint32_t SystemAdler32(uint32_t adler, const uint8_t* data, size_t size)
+{
+	uint32_t a = adler & 0xFFFF;
+	uint32_t b = adler >> 16;
+
+	while(size != 0)
+	{
+		// Sums cannot overflow before 5552 bytes.
+		size_t n = (size > 5552)? 5552 : size;
+
+		size -= n;
+
+		while(n--)
+		{
+			a += *data++;
+			b += a;
+		}
+
+		a %= SYSTEM_ADLER32_MOD;
+		b %= SYSTEM_ADLER32_MOD;
+	}
+
+	return (b << 16) | a;
+}
+
+/* *******************************************************************
+ * 
+ * @name: void SystemFlushCache(void)
+ * 
+ * @brief:
+ * 	Calls BIOS FlushCache() (A0h:44h), so that instructions written
+ * 	by the CPU are not executed from stale instruction cache lines.
+ * 
+ * *******************************************************************/
+
+void SystemFlushCache(void)
+{
+	__asm__ volatile(	"li $t1, 0x44\n"
+						"li $t0, 0xA0\n"
+						"jalr $t0\n"
+						"nop\n"
+						:
+						:
+						:	"$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+							"$t0", "$t1", "$t2", "$t3", "$t4", "$t5",
+							"$t6", "$t7", "$t8", "$t9", "$ra", "memory"	);
+}
+
+/* *******************************************************************
+ * 
+ * @name: size_t SystemDecompressRLE(const uint8_t* src, size_t szSrc,
+ * 									uint8_t* dst, size_t szDst)
+ * 
+ * @brief:
+ * 	Decompresses RLE data generated by Tools/BmpToC.c. Control byte
+ * 	below 0x80 is followed by (control + 1) literal bytes, otherwise
+ * 	next byte is repeated (control - 0x80 + 3) times.
+ * 
+ * @return:
+ * 	Number of bytes written into "dst".
+ * 
+ * *******************************************************************/
+
+size_t SystemDecompressRLE(const uint8_t* src, size_t szSrc, uint8_t* dst, size_t szDst)
+{
+	const uint8_t* end = src + szSrc;
+	size_t written = 0;
+
+	while(src < end)
+	{
+		uint8_t control = *src++;
+		size_t length;
+
+		if(control < 0x80)
+		{
+			length = control + 1;
+
+			if( (length > (size_t)(end - src)) || (length > (szDst - written)) )
+			{
+				break;
+			}
+
+			memcpy(&dst[written], src, length);
+			src += length;
+		}
+		else
+		{
+			length = control - 0x80 + 3;
+
+			if( (src >= end) || (length > (szDst - written)) )
+			{
+				break;
+			}
+
+			memset(&dst[written], *src++, length);
+		}
+
+		written += length;
+	}
+
+	return written;
+}
+
+/* *******************************************************************
+ * 
+ * @name: void SystemBootProfileMark(const char* name)
+ * 
+ * @brief:
+ * 	Ends boot step "name", storing time elapsed since previous call.
+ * 
+ * @remarks:
+ * 	Before ISR_SystemBootVBlank() is installed, only one counter
+ * 	wrap per step can be told apart, so steps where counter wrapped
+ * 	are flagged as overflowed.
+ * 
+ * *******************************************************************/
+
+void SystemBootProfileMark(const char* name)
+{
+	// Read first, so that a wrap right before timestamp is not lost.
+	bool wrapped = (RCNT1_MODE & RCNT1_REACHED_FFFF)? true : false;
+	uint32_t timestamp = SystemGetTimestamp();
+	TYPE_BOOT_STEP* step;
+
+	if(boot_steps_count >= SYSTEM_MAX_BOOT_STEPS)
+	{
+		return;
+	}
+
+	step = &boot_steps[boot_steps_count++];
+
+	strncpy(step->name, name, SYSTEM_BOOT_STEP_NAME_SIZE - 1);
+	step->name[SYSTEM_BOOT_STEP_NAME_SIZE - 1] = '\0';
+	step->ticks = timestamp - boot_last_timestamp;
+	step->overflow = ( (wrapped == true) && (boot_wraps_tracked == false) )? 1 : 0;
+
+	boot_last_timestamp = timestamp;
+}
+
+const TYPE_BOOT_STEP* SystemGetBootProfile(uint8_t* nSteps)
+{
+	*nSteps = boot_steps_count;
+
+	return boot_steps;
+}
+
+void SystemBootProfileReport(void)
+{
+	uint32_t total = 0;
+	uint8_t i;
+
+	for(i = 0; i < boot_steps_count; i++)
+	{
+		total += boot_steps[i].ticks;
+
+		dprintf("%-16s %5d ms%s\n",
+				boot_steps[i].name,
+				(boot_steps[i].ticks * 1000) / SYSTEM_TIMESTAMP_FREQUENCY,
+				(boot_steps[i].overflow != 0)? " (counter wrapped, inaccurate)" : "");
+	}
+
+	dprintf("Boot time: %d ms\n", (total * 1000) / SYSTEM_TIMESTAMP_FREQUENCY);
+}
+
+/* *******************************************************************
+ * 
+ * @name: void SystemInitTimestamp(void)
+ * 
+ * @brief:
+ * 	Sets root counter 1 as a free-running horizontal blank counter,
+ * 	used as time base for SystemGetTimestamp().
+ * 
+ * *******************************************************************/
+
+void SystemInitTimestamp(void)
+{
+	// Writing to mode register also resets counter value.
+	RCNT1_MODE = RCNT1_HBLANK_SOURCE;
+
+	timestamp_high = 0;
+	timestamp_last = 0;
+	// First boot step is measured from here.
+	boot_last_timestamp = 0;
+	boot_wraps_tracked = false;
+}
+
+/* *******************************************************************
+ * 
+ * @name: uint32_t SystemGetTimestamp(void)
+ * 
+ * @return:
+ * 	Number of horizontal blanks since SystemInitTimestamp() was
+ * 	called. SYSTEM_TIMESTAMP_FREQUENCY ticks equal 1 second.
+ * 
+ * @remarks:
+ * 	Root counter 1 is only 16 bits long, so it wraps every ~4 s.
+ * 	This function must be called more often than that so that
+ * 	overflows are not missed.
+ * 
+ * *******************************************************************/
+
+uint32_t SystemGetTimestamp(void)
+{
+	uint32_t sr = SystemMaskInterrupts();
+	uint16_t count = (uint16_t)RCNT1_COUNT;
+	uint32_t timestamp;
+
+	// Also called from VBlank ISR, so counter must be read and
+	// extended atomically. Otherwise, a wrap could be counted twice.
+	if(count < timestamp_last)
+	{
+		timestamp_high += 0x10000;
+	}
+
+	timestamp_last = count;
+	timestamp = timestamp_high | count;
+
+	SystemRestoreInterrupts(sr);
+
+	return timestamp;
+}
+
+/* *******************************************************************
+ * 
+ * @name: uint32_t SystemMaskInterrupts(void)
+ * 
+ * @brief:
+ * 	Disables interrupts on CPU (COP0 status register) and returns
+ * 	previous status, to be passed to SystemRestoreInterrupts().
+ * 	Much cheaper than BIOS EnterCriticalSection(), so it can be
+ * 	used for short read-modify-write sequences.
+ * 
+ * *******************************************************************/
+
+uint32_t SystemMaskInterrupts(void)
+{
+	uint32_t sr;
+	uint32_t tmp;
+
+	__asm__ volatile(	"mfc0 %0, $12\n"
+						"nop\n"
+						"and %1, %0, %2\n"
+						"mtc0 %1, $12\n"
+						"nop\n"
+						: "=&r"(sr), "=&r"(tmp)
+						: "r"(~COP0_SR_IEC)	);
+
+	return sr;
+}
+
+void SystemRestoreInterrupts(uint32_t sr)
+{
+	__asm__ volatile("mtc0 %0, $12\n" : : "r"(sr));
+}
+
 /* *******************************************************************
  * 
  * @name: void SystemDisableScreenRefresh(void)
@@ -258,15 +569,19 @@ bool System1SecondTick(void)
 
 bool SystemLoadFileToBuffer(char* fname, uint32_t init_pos, uint8_t* buffer, uint32_t szBuffer)
 {
-	FILE *f;
-	int32_t size;
+	uint32_t size;
 	
 	// Wait for possible previous operation from the GPU before entering this section.
-	while( (SystemIsBusy() == true) || (GfxIsGPUBusy() == true) );
+	while(SystemIsBusy() == true);
+
+	GfxWaitGPUIdle();
 	
+	TRACE_BEGIN(TRACE_EVENT_CD_LOAD, szBuffer);
+
 	if(fname == NULL)
 	{
 		dprintf("SystemLoadFile: NULL fname!\n");
+		TRACE_END(TRACE_EVENT_CD_LOAD, 0);
 		return false;
 	}
 	
@@ -274,93 +589,85 @@ bool SystemLoadFileToBuffer(char* fname, uint32_t init_pos, uint8_t* buffer, uin
 	
 	system_busy = true;
 	
-	SystemDisableVBlankInterrupt();
-	
-	f = fopen(fname, "r");
-	
-	if(f == NULL)
+	if(CdRomOpen(fname) == false)
 	{
 		dprintf("SystemLoadFile: file could not be found!\n");
 		//File couldn't be found
+		system_busy = false;
+		TRACE_END(TRACE_EVENT_CD_LOAD, 0);
 		return false;
 	}
 
-	fseek(f, init_pos, SEEK_END);
+	size = CdRomGetFileSize();
 
-	size = ftell(f);
+	if(init_pos > size)
+	{
+		init_pos = size;
+	}
+
+	size -= init_pos;
 	
 	if(size > szBuffer)
 	{
 		dprintf("SystemLoadFile: Exceeds file buffer size (%d bytes)\n",size);
-		//Bigger than 128 kB (buffer's max size)
+		CdRomClose();
+		system_busy = false;
+		TRACE_END(TRACE_EVENT_CD_LOAD, 0);
 		return false;
 	}
 	
-	fseek(f, init_pos, SEEK_SET); //f->pos = 0;
+	CdRomRead(NULL, init_pos);
 	
-	fread(buffer, sizeof(char), size, f);
-	
-	fclose(f);
+	if(CdRomRead(buffer, size) != size)
+	{
+		dprintf("SystemLoadFile: could not read \"%s\"!\n",fname);
+		CdRomClose();
+		system_busy = false;
+		TRACE_END(TRACE_EVENT_CD_LOAD, 0);
+		return false;
+	}
 	
-	SystemEnableVBlankInterrupt();
+	SystemPrefetchNextFile();
 	
 	system_busy = false;
 	
+	TRACE_END(TRACE_EVENT_CD_LOAD, size);
+
 	dprintf("File \"%s\" loaded successfully!\n",fname);
 	
 	return true;
 }
 
-void SystemSetBusyFlag(bool value)
-{
-    system_busy = value;
-}
-
 /* ****************************************************************************************
  * 
- * @name	bool SystemLoadFile(char*fname)
+ * @name	void SystemSetNextFile(char* fname)
  * 
  * @author: Xavier Del Campo
  * 
- * @brief:	Given an input file name, it loads its conents into internal buffer.
- *
- * @return:	true if file has been loaded successfully, false otherwise.
+ * @brief:	Tells next call to SystemLoadFileToBuffer() which file will be loaded
+ * 			after it, so that CD-ROM starts reading it in the background as soon as
+ * 			current file has been read.
  * 
  * ****************************************************************************************/
 
-bool SystemLoadFile(char*fname)
+void SystemSetNextFile(char* fname)
 {
-	return SystemLoadFileToBuffer(fname,0,file_buffer,sizeof(file_buffer));
+	next_file = fname;
 }
 
-/* ******************************************************************
- * 
- * @name	uint8_t* SystemGetBufferAddress(void)
- * 
- * @author: Xavier Del Campo
- *
- * @return:	Reportedly, returns internal buffer initial address.
- * 
- * *****************************************************************/
-
-uint8_t* SystemGetBufferAddress(void)
+// Starts reading file set by SystemSetNextFile(), if any, in the background.
+void SystemPrefetchNextFile(void)
 {
-	return file_buffer;
+	if(next_file != NULL)
+	{
+		CdRomOpen(next_file);
+		next_file = NULL;
+	}
 }
 
-/* ******************************************************************
- * 
- * @name	void SystemClearBuffer(void)
- * 
- * @author: Xavier Del Campo
- *
- * @return:	Fills internal buffer with zeros
- * 
- * *****************************************************************/
-
-void SystemClearBuffer(void)
+void SystemSetBusyFlag(bool value)
 {
-	memset(file_buffer, 0, sizeof(file_buffer));
+    system_busy = value;
 }
 
 /* ******************************************************************
@@ -434,29 +741,138 @@ void SystemPrintStackPointerAddress(void)
 
 }
 
+/* *******************************************************************
+ *
+ * @name: static uint32_t* SystemStackPaint(uint32_t* bottom)
+ *
+ * @brief:
+ * 	Fills stack with END_STACK_PATTERN from "bottom" up to somewhere
+ * 	below current stack pointer, and returns where it stopped.
+ *
+ * *******************************************************************/
+
+static uint32_t* SystemStackPaint(uint32_t* bottom)
+{
+	uint32_t marker;
+	uint32_t* top = (uint32_t*)(((uint32_t)&marker - STACK_PAINT_MARGIN) & ~3);
+	uint32_t* ptr;
+
+	for(ptr = bottom; ptr < top; ptr++)
+	{
+		*ptr = END_STACK_PATTERN;
+	}
+
+	return top;
+}
+
+/* *******************************************************************
+ *
+ * @name: static size_t SystemStackUnused(const uint32_t* bottom, const uint32_t* top)
+ *
+ * @brief:
+ * 	Returns size in bytes of stack area, starting from "bottom",
+ * 	which still holds END_STACK_PATTERN (never used so far).
+ *
+ * *******************************************************************/
+
+static size_t SystemStackUnused(const uint32_t* bottom, const uint32_t* top)
+{
+	const uint32_t* ptr = bottom;
+
+	while( (ptr < top) && (*ptr == END_STACK_PATTERN) )
+	{
+		ptr++;
+	}
+
+	return (size_t)((const uint8_t*)ptr - (const uint8_t*)bottom);
+}
+
 void SystemCheckStack(void)
 {
-	uint32_t * ptrStack = BEGIN_STACK_ADDRESS;
-	uint32_t data;
-	
-	ptrStack -= STACK_SIZE;
-	data = (*ptrStack);
-	
-	if(data != END_STACK_PATTERN)
+	stack_stats.main_used = STACK_SIZE - SystemStackUnused(STACK_BOTTOM_ADDRESS, BEGIN_STACK_ADDRESS);
+
+	if( (stack_stats.overflow == 0) && (*STACK_BOTTOM_ADDRESS != END_STACK_PATTERN) )
 	{
-		dprintf("Stack overflow?\n");
-		
-		while(1);
+		// Reported only once. Whatever lies below stack might
+		// have been overwritten.
+		stack_stats.overflow = 1;
+		dprintf("Stack overflow!\n");
 	}
+
+	stack_stats.isr_used = ISR_STACK_SIZE - SystemStackUnused(SystemIsrStack, &SystemIsrStack[ISR_STACK_SIZE >> 2]);
 }
 
+/* *******************************************************************
+ *
+ * @name: void SystemSetStackPattern(void)
+ *
+ * @brief:
+ * 	Paints whole loader stack below current frame, and whole ISR
+ * 	stack, so that SystemCheckStack() can find their high-water
+ * 	marks.
+ *
+ * *******************************************************************/
+
 void SystemSetStackPattern(void)
 {
-	uint32_t * ptrStack = BEGIN_STACK_ADDRESS;
-	
-	ptrStack -= STACK_SIZE;
-	
-	*ptrStack = END_STACK_PATTERN;
+	uint32_t sp;
+	size_t i;
+
+	stack_stats.main_size = STACK_SIZE;
+	stack_stats.isr_size = ISR_STACK_SIZE;
+	stack_stats.isr_top = (uint32_t)&SystemIsrStack[ISR_STACK_SIZE >> 2];
+
+	// Not in use yet: VBlank ISR is installed later by SerialInit().
+	for(i = 0; i < (ISR_STACK_SIZE >> 2); i++)
+	{
+		SystemIsrStack[i] = END_STACK_PATTERN;
+	}
+
+	sp = (uint32_t)SystemStackPaint(STACK_BOTTOM_ADDRESS);
+
+	if( (sp <= (uint32_t)STACK_BOTTOM_ADDRESS) || (sp > SYSTEM_STACK_TOP) )
+	{
+		dprintf("Stack pointer 0x%08X outside loader stack!\n", sp);
+	}
+}
+
+/* *******************************************************************
+ *
+ * 	SystemCallOnIsrStack: calls "handler" (in $a0) with stack pointer
+ * 	set to top of SystemIsrStack[], and restores caller stack pointer
+ * 	on return.
+ *
+ * 	Interrupt handlers are called by BIOS/PSXSDK on a stack not
+ * 	owned by OpenSend, so it cannot be painted safely. Running ISR
+ * 	on its own stack lets its high-water mark be measured. Interrupts
+ * 	are disabled meanwhile, so it is never entered twice.
+ *
+ * *******************************************************************/
+
+__asm__(
+"	.text\n"
+"	.globl SystemCallOnIsrStack\n"
+"	.set push\n"
+"	.set noreorder\n"
+"SystemCallOnIsrStack:\n"
+"	lui $t0, %hi(SystemIsrStack + " SYSTEM_STRINGIFY(ISR_STACK_SIZE) " - " SYSTEM_STRINGIFY(ISR_STACK_FRAME_SIZE) ")\n"
+"	addiu $t0, $t0, %lo(SystemIsrStack + " SYSTEM_STRINGIFY(ISR_STACK_SIZE) " - " SYSTEM_STRINGIFY(ISR_STACK_FRAME_SIZE) ")\n"
+"	sw $sp, 16($t0)\n"
+"	sw $ra, 20($t0)\n"
+"	jalr $a0\n"
+"	move $sp, $t0\n"
+"	lw $ra, 20($sp)\n"
+"	lw $sp, 16($sp)\n"
+"	jr $ra\n"
+"	nop\n"
+"	.set pop\n"
+);
+
+void SystemGetStackStats(TYPE_STACK_STATS* stats)
+{
+	SystemCheckStack();
+
+	*stats = stack_stats;
 }
 
 int32_t SystemIndexOfStringArray(char* str, char** array)
@@ -484,10 +900,18 @@ void SystemCyclicHandler(void)
 
 void SystemDisableVBlankInterrupt(void)
 {
-	I_MASK &= ~(0x00000001);
+	if(I_MASK & I_MASK_VBLANK)
+	{
+		IrqStatsMaskBegin();
+		I_MASK &= ~I_MASK_VBLANK;
+	}
 }
 
-void SystemEnableVBlankInterrupt(void)
+void SystemEnableVBlankInterrupt(void* caller)
 {
-	I_MASK |= (0x00000001);
+	if(!(I_MASK & I_MASK_VBLANK))
+	{
+		IrqStatsMaskEnd((I_STAT & I_MASK_VBLANK)? true : false, caller);
+		I_MASK |= I_MASK_VBLANK;
+	}
 }
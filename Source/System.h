@@ -8,6 +8,10 @@
 #include "Global_Inc.h"
 #include "Gfx.h"
 #include "Serial.h"
+#include "CdRom.h"
+#include "Memory.h"
+#include "Trace.h"
+#include "IrqStats.h"
 
 /* **************************************
  * 	Defines								*
@@ -16,6 +20,52 @@
 #define TIMER_PRESCALER_1_SECOND    10
 #define TIMER_PRESCALER_1_MINUTE    (TIMER_PRESCALER_1_SECOND * 60)
 
+// Horizontal blanks per second.
+#ifdef _PAL_MODE_
+#define SYSTEM_TIMESTAMP_FREQUENCY  15625
+#else
+#define SYSTEM_TIMESTAMP_FREQUENCY  15734
+#endif // _PAL_MODE_
+
+// Loader stack, as set by "STACK" on SYSTEM.CNF. It grows downwards
+// from SYSTEM_STACK_TOP.
+#define SYSTEM_STACK_TOP            0x801FF800
+#define SYSTEM_STACK_SIZE           0x1000
+
+#define SYSTEM_MAX_BOOT_STEPS       16
+#define SYSTEM_BOOT_STEP_NAME_SIZE  16
+
+/* **************************************
+ * 	Structs and enums					*
+ * **************************************/
+
+typedef struct t_BootStep
+{
+	char name[SYSTEM_BOOT_STEP_NAME_SIZE];
+	// Duration, in SYSTEM_TIMESTAMP_FREQUENCY ticks.
+	uint32_t ticks;
+	// 1 if root counter wrapped while its wraps were not tracked,
+	// so "ticks" could be short by a multiple of 65536. 0 otherwise.
+	uint32_t overflow;
+}TYPE_BOOT_STEP;
+
+// Stack usage, in bytes.
+typedef struct t_StackStats
+{
+	uint32_t main_size;
+	// High-water mark since boot.
+	uint32_t main_used;
+	// Interrupt context: stack used by handlers called through
+	// SystemCallOnIsrStack(). Stack used by BIOS exception
+	// dispatcher before them is not accounted.
+	uint32_t isr_size;
+	uint32_t isr_used;
+	uint32_t isr_top;
+	// 1 if lowest word of loader stack was overwritten, 0 otherwise.
+	// Kept as a 32-bit word so structure is sent to PC as is.
+	uint32_t overflow;
+}TYPE_STACK_STATS;
+
 /* **************************************
  * 	Global Prototypes					*
  * **************************************/
@@ -34,18 +84,18 @@ void SystemSetRandSeed(void);
 // Returns VSync flag value
 bool SystemRefreshNeeded(void);
 
-// Loads a file into system's internal buffer
-bool SystemLoadFile(char*fname);
-
 // Loads a file into desired buffer
 bool SystemLoadFileToBuffer(char* fname, uint32_t init_pos, uint8_t* buffer, uint32_t szBuffer);
 
+// Sets file to be read in the background once current file is loaded
+void SystemSetNextFile(char* fname);
+
+// Starts reading file set by SystemSetNextFile() in the background
+void SystemPrefetchNextFile(void);
+
 // Clears VSync flag after each frame
 void SystemDisableScreenRefresh(void);
 
-// Returns file buffer address
-uint8_t* SystemGetBufferAddress(void);
-
 // Tells whether srand() has been called using a pseudo-random value
 bool SystemIsRandSeedSet(void);
 
@@ -76,6 +126,38 @@ bool SystemGetEmergencyMode(void);
 // (Experimental)
 uint64_t SystemGetGlobalTimer(void);
 
+// Starts root counter used by SystemGetTimestamp().
+void SystemInitTimestamp(void);
+
+// Returns root counter based timestamp (see SYSTEM_TIMESTAMP_FREQUENCY).
+uint32_t SystemGetTimestamp(void);
+
+// Masks CPU interrupts and returns previous state, so short critical
+// sections can be built around it:
+//	uint32_t sr = SystemMaskInterrupts();
+//	...
+//	SystemRestoreInterrupts(sr);
+uint32_t SystemMaskInterrupts(void);
+void SystemRestoreInterrupts(uint32_t sr);
+
+// Returns Adler-32 checksum of "data". Use 1 as initial "adler" value.
+uint32_t SystemAdler32(uint32_t adler, const uint8_t* data, size_t size);
+
+// Invalidates instruction cache after code has been written to RAM.
+void SystemFlushCache(void);
+
+// Decompresses RLE data (see Tools/BmpToC.c). Returns bytes written.
+size_t SystemDecompressRLE(const uint8_t* src, size_t szSrc, uint8_t* dst, size_t szDst);
+
+// Stores time elapsed since previous boot step as step "name".
+void SystemBootProfileMark(const char* name);
+
+// Returns boot steps stored so far.
+const TYPE_BOOT_STEP* SystemGetBootProfile(uint8_t* nSteps);
+
+// Prints boot steps duration via dprintf().
+void SystemBootProfileReport(void);
+
 // Returns whether critical section of code is being entered
 volatile bool SystemIsBusy(void);
 
@@ -103,13 +185,20 @@ int32_t SystemIndexOf_U8(uint8_t value, uint8_t* array, uint32_t from, uint32_t
 
 void SystemCyclicHandler(void);
 
-size_t SystemGetBufferSize(void);
+// Updates stack high-water marks and reports stack overflows.
+// Called by SystemCyclicHandler().
+void SystemCheckStack(void);
+
+// Runs "handler" on a stack owned by loader, so that interrupt
+// context stack usage is measured. To be called from ISRs only.
+void SystemCallOnIsrStack(void (*handler)(void));
 
-void SystemClearBuffer(void);
+void SystemGetStackStats(TYPE_STACK_STATS* stats);
 
 void SystemDisableVBlankInterrupt(void);
 
-void SystemEnableVBlankInterrupt(void);
+// "caller" is reported by IrqStats as responsible for masked section.
+void SystemEnableVBlankInterrupt(void* caller);
 
 /* **************************************
  * 	Global Variables					*	
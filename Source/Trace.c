@@ -0,0 +1,85 @@
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include "Trace.h"
+#include "System.h"
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+#define RCNT1_COUNT (*(volatile unsigned int*)0x1F801110)
+#define TRACE_MASK (TRACE_SIZE - 1)
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+static TYPE_TRACE_RECORD trace_ring[TRACE_SIZE];
+// Total number of records written. Never wraps in practice.
+static uint32_t trace_count;
+static volatile bool trace_disabled;
+
+/* *******************************************************************
+ *
+ * @name: void TraceWrite(TRACE_EVENT event, TRACE_PHASE phase, uint32_t arg)
+ *
+ * @brief:
+ * 	Stores a record into trace ring. Timestamp is read directly from
+ * 	root counter 1 (horizontal blanks), without extending it to 32
+ * 	bits: host tool does it, since events happen at least every
+ * 	frame (TRACE_EVENT_VBLANK_ISR) and counter wraps every ~4 s.
+ *
+ * @remarks:
+ * 	Called from both main loop and VBlank ISR. Interrupts are masked
+ * 	while record is written, so records are never lost or mixed.
+ *
+ * *******************************************************************/
+
+void TraceWrite(TRACE_EVENT event, TRACE_PHASE phase, uint32_t arg)
+{
+	TYPE_TRACE_RECORD* record;
+	uint32_t sr;
+
+	if(trace_disabled == true)
+	{
+		return;
+	}
+
+	sr = SystemMaskInterrupts();
+
+	record = &trace_ring[trace_count++ & TRACE_MASK];
+	record->event = (uint8_t)event;
+	record->phase = (uint8_t)phase;
+	record->time = (uint16_t)RCNT1_COUNT;
+	record->arg = arg;
+
+	SystemRestoreInterrupts(sr);
+}
+
+void TraceSetEnabled(bool enabled)
+{
+	trace_disabled = !enabled;
+}
+
+void TraceGetRecords(	const TYPE_TRACE_RECORD** first, size_t* n1,
+						const TYPE_TRACE_RECORD** second, size_t* n2	)
+{
+	if(trace_count <= TRACE_SIZE)
+	{
+		*first = trace_ring;
+		*n1 = trace_count;
+		*second = NULL;
+		*n2 = 0;
+	}
+	else
+	{
+		uint32_t oldest = trace_count & TRACE_MASK;
+
+		*first = &trace_ring[oldest];
+		*n1 = TRACE_SIZE - oldest;
+		*second = trace_ring;
+		*n2 = oldest;
+	}
+}
@@ -0,0 +1,82 @@
+#ifndef __TRACE_HEADER__
+#define __TRACE_HEADER__
+
+/* **************************************
+ * 	Includes							*
+ * **************************************/
+
+#include "Global_Inc.h"
+
+/* **************************************
+ * 	Defines								*
+ * **************************************/
+
+// Number of records kept. Older records are overwritten.
+// Must be a power of two.
+#define TRACE_SIZE 512
+
+// Instrumentation macros. They compile to nothing unless _TRACE_
+// is defined, so they can be left on hot paths.
+#ifdef _TRACE_
+#define TRACE_BEGIN(event, arg)		TraceWrite((event), TRACE_PHASE_BEGIN, (uint32_t)(arg))
+#define TRACE_END(event, arg)		TraceWrite((event), TRACE_PHASE_END, (uint32_t)(arg))
+#define TRACE_INSTANT(event, arg)	TraceWrite((event), TRACE_PHASE_INSTANT, (uint32_t)(arg))
+#else
+#define TRACE_BEGIN(event, arg)
+#define TRACE_END(event, arg)
+#define TRACE_INSTANT(event, arg)
+#endif // _TRACE_
+
+/* **************************************
+ * 	Structs and enums					*
+ * **************************************/
+
+// Host tool (Tools/TraceToJson.c) must be updated when adding events.
+typedef enum
+{
+	// Argument: new SERIAL_STATE.
+	TRACE_EVENT_SERIAL_STATE = 0,
+	TRACE_EVENT_VBLANK_ISR,
+	// Argument: primitive list usage.
+	TRACE_EVENT_GFX_DRAW,
+	// From primitive list submission until GPU is found idle.
+	// Argument: fence.
+	TRACE_EVENT_GPU_LIST,
+	// Argument: buffer size on begin, bytes read on end.
+	TRACE_EVENT_CD_LOAD,
+}TRACE_EVENT;
+
+// Same values as Chrome trace event phases.
+typedef enum
+{
+	TRACE_PHASE_BEGIN = 'B',
+	TRACE_PHASE_END = 'E',
+	TRACE_PHASE_INSTANT = 'i'
+}TRACE_PHASE;
+
+typedef struct t_TraceRecord
+{
+	uint8_t event;
+	uint8_t phase;
+	// Lower 16 bits of SystemGetTimestamp() time base.
+	uint16_t time;
+	uint32_t arg;
+}TYPE_TRACE_RECORD;
+
+/* **************************************
+ * 	Global Prototypes					*
+ * **************************************/
+
+// Use TRACE_BEGIN(), TRACE_END() and TRACE_INSTANT() instead.
+void TraceWrite(TRACE_EVENT event, TRACE_PHASE phase, uint32_t arg);
+
+// Stops recording, so records can be read without being overwritten.
+void TraceSetEnabled(bool enabled);
+
+// Returns oldest record and number of records. Records wrap around
+// TRACE_SIZE, so they may be split into two consecutive areas:
+// "n1" records from "first", then "n2" records from "second".
+void TraceGetRecords(	const TYPE_TRACE_RECORD** first, size_t* n1,
+						const TYPE_TRACE_RECORD** second, size_t* n2	);
+
+#endif // __TRACE_HEADER__
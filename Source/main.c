@@ -7,6 +7,7 @@
 #include "Serial.h"
 #include "LoadMenu.h"
 #include "EndAnimation.h"
+#include "Resident.h"
 
 /* *************************************
  * 	Defines
@@ -14,6 +15,9 @@
 
 #define PSX_EXE_HEADER_SIZE 2048
 #define EXE_DATA_PACKET_SIZE 8
+// Only the first bytes from PSX-EXE header are needed: up to
+// stack address and size, so resident mode can check them.
+#define PSX_EXE_HEADER_READ_SIZE 0x38
 
 /* *************************************
  * 	Local Prototypes
@@ -35,7 +39,8 @@ extern void _start(void);
 
 int main(void)
 {
-    uint8_t* inBuffer = SystemGetBufferAddress();
+    MEMORY_MARK mark;
+    uint8_t* inBuffer;
    // int (*exeAddress)(void);
 
 	//System initialization
@@ -46,23 +51,42 @@ int main(void)
 
     LoadMenuInit();
 
+    SystemBootProfileMark("LoadMenuInit");
+
+    SystemBootProfileReport();
+
+    mark = MemoryGetMark();
+
+    inBuffer = MemoryAlloc(PSX_EXE_HEADER_READ_SIZE);
+
+    if(inBuffer == NULL)
+    {
+        dprintf("Could not allocate PSX-EXE header buffer!\n");
+        return -1;
+    }
+
     if(1)
     {
         uint32_t initPC_Address;
         uint32_t RAMDest_Address;
+        uint32_t BSS_Address;
+        uint32_t BSS_Size;
+        uint32_t Stack_Address;
+        uint32_t Stack_Size;
         uint32_t ExeSize = 0;
         uint32_t i;
         void (*exeAddress)(void);
 
-        GfxSetGlobalLuminance(0);
+        // Black text over loader background.
+        FontSetLuminance(&SmallFont, 0);
 
         SerialInit();
 
-        // Read PSX-EXE header (32 bytes will be enough).
+        // Read first PSX-EXE header bytes (until stack size).
 
         SerialSetState(SERIAL_STATE_READING_HEADER);
 
-        SerialRead(inBuffer, 32);
+        SerialRead(inBuffer, PSX_EXE_HEADER_READ_SIZE);
 
         // Get initial program counter address from PSX-EXE header.
 
@@ -80,9 +104,16 @@ int main(void)
 
         //dprintf("RAMDest_Address = 0x%08X\n", RAMDest_Address);
 
+        // BSS and stack, which PSX-EXE startup code clears and uses.
+
+        BSS_Address = (inBuffer[0x28] | (inBuffer[0x29] << 8) | (inBuffer[0x2A] << 16) | (inBuffer[0x2B] << 24) );
+        BSS_Size = (inBuffer[0x2C] | (inBuffer[0x2D] << 8) | (inBuffer[0x2E] << 16) | (inBuffer[0x2F] << 24) );
+        Stack_Address = (inBuffer[0x30] | (inBuffer[0x31] << 8) | (inBuffer[0x32] << 16) | (inBuffer[0x33] << 24) );
+        Stack_Size = (inBuffer[0x34] | (inBuffer[0x35] << 8) | (inBuffer[0x36] << 16) | (inBuffer[0x37] << 24) );
+
         // We have received all data correctly. Send ACK.
 
-        memset(inBuffer, 0, SystemGetBufferSize());
+        memset(inBuffer, 0, PSX_EXE_HEADER_READ_SIZE);
 
         SerialSetState(SERIAL_STATE_WRITING_ACK);
 
@@ -101,6 +132,8 @@ int main(void)
 
         SerialSetExeSize(ExeSize);
 
+        MemoryRelease(mark);
+
         //DEBUG_PRINT_VAR(ExeSize);
 
         SerialSetState(SERIAL_STATE_CLEANING_MEMORY);
@@ -119,7 +152,7 @@ int main(void)
 
         SerialSetState(SERIAL_STATE_READING_EXE_DATA);
 
-        while(GfxIsGPUBusy() == true);
+        GfxWaitGPUIdle();
 
         for(i = 0; i < ExeSize; i += EXE_DATA_PACKET_SIZE)
         {
@@ -145,12 +178,44 @@ int main(void)
 
         SetVBlankHandler(&ISR_SystemDefaultVBlank);
 
+        // Go back to double buffering for end animation.
+        GfxDirtyModeDisable();
+
         // Make a pretty animation before exeting OpenSend application.
 
+        if(SerialIsInstantExecRequested() == true)
+        {
+            EndAnimationSetDuration(0);
+        }
+        else
+        {
+            EndAnimationSetDuration(END_ANIMATION_DEFAULT_DURATION_MS);
+        }
+
         EndAnimation();
 
+        MemoryReport();
+
+        CdRomDeInit();
+
         PSX_DeInit();
 
+        if(SerialIsResidentExecRequested() == true)
+        {
+            if(	(ResidentIsExeRangeSafe(RAMDest_Address, ExeSize) == true)
+                            &&
+                (ResidentIsExeRangeSafe(BSS_Address, BSS_Size) == true)
+                            &&
+                (ResidentIsExeStackSafe(Stack_Address, Stack_Size) == true)	)
+            {
+                ResidentInstall();
+            }
+            else
+            {
+                dprintf("PSX-EXE overlaps OpenSend, so it cannot stay resident!\n");
+            }
+        }
+
         // PSX-EXE has been successfully loaded into RAM. Run executable!
 
         //dprintf("Entering exe...\n");
@@ -0,0 +1,262 @@
+/* *************************************
+ * 	BmpToC: converts a 4-bit BMP image into a RLE-compressed TIM
+ * 	file, stored as a C array so it can be linked into OpenSend.
+ *
+ * 	Usage: BmpToC <input.bmp> <output.c> <symbol> <x> <y> <clut x> <clut y>
+ * 	i.e.: BmpToC ../Sprites/Font_2_4bit.bmp FontData.c FontSmallData 768 288 384 499
+ *
+ * 	Palette conversion follows the usual TIM conventions: magenta
+ * 	(255, 0, 255) becomes transparent (0x0000) and black becomes
+ * 	0x8000, so it is not treated as transparent by the GPU.
+ *
+ * 	Generated file defines (and includes a header named as it,
+ * 	i.e.: FontData.h, which must declare them):
+ * 		const uint8_t <symbol>[];			// Compressed TIM
+ * 		const size_t <symbol>Size;			// Compressed size
+ * 		const size_t <symbol>TimSize;		// Uncompressed size
+ *
+ * 	RLE format (see SystemDecompressRLE()):
+ * 		Control byte < 0x80: (control + 1) literal bytes follow.
+ * 		Control byte >= 0x80: next byte repeated (control - 0x80 + 3) times.
+ * *************************************/
+
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+#define BMP_HEADER_SIZE 54
+#define BMP_PALETTE_COLORS 16
+#define TIM_MAGIC 0x10
+#define TIM_4BPP_CLUT 0x08
+#define TIM_BLOCK_HEADER_SIZE 12
+#define RLE_MAX_LITERAL 0x80
+#define RLE_MIN_RUN 3
+#define RLE_MAX_RUN (0x7F + RLE_MIN_RUN)
+#define BYTES_PER_LINE 12
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+static uint8_t tim[0x10000];
+static size_t szTim;
+static uint8_t rle[0x10000 + (0x10000 / RLE_MAX_LITERAL) + 1];
+static size_t szRle;
+
+static uint32_t BmpGet32(const uint8_t* data)
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void TimPut16(uint16_t value)
+{
+	tim[szTim++] = (uint8_t)value;
+	tim[szTim++] = (uint8_t)(value >> 8);
+}
+
+static void TimPut32(uint32_t value)
+{
+	TimPut16((uint16_t)value);
+	TimPut16((uint16_t)(value >> 16));
+}
+
+static uint16_t TimColor(uint8_t r, uint8_t g, uint8_t b)
+{
+	if( (r == 0xFF) && (g == 0) && (b == 0xFF) )
+	{
+		return 0x0000;
+	}
+	else if( (r == 0) && (g == 0) && (b == 0) )
+	{
+		return 0x8000;
+	}
+
+	return (r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10);
+}
+
+static void RleCompress(void)
+{
+	size_t i = 0;
+
+	while(i < szTim)
+	{
+		size_t run = 1;
+
+		while( ((i + run) < szTim) && (tim[i + run] == tim[i]) && (run < RLE_MAX_RUN) )
+		{
+			run++;
+		}
+
+		if(run >= RLE_MIN_RUN)
+		{
+			rle[szRle++] = (uint8_t)(0x80 + run - RLE_MIN_RUN);
+			rle[szRle++] = tim[i];
+			i += run;
+		}
+		else
+		{
+			// Literal block lasts until next run or maximum length.
+			size_t start = i;
+			size_t length = 0;
+
+			while( (i < szTim) && (length < RLE_MAX_LITERAL) )
+			{
+				if(	((i + 2) < szTim)
+							&&
+					(tim[i] == tim[i + 1]) && (tim[i] == tim[i + 2])	)
+				{
+					break;
+				}
+
+				i++;
+				length++;
+			}
+
+			rle[szRle++] = (uint8_t)(length - 1);
+			memcpy(&rle[szRle], &tim[start], length);
+			szRle += length;
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	static uint8_t bmp[0x10000];
+	size_t szBmp;
+	char header[256];
+	char* name;
+	uint32_t offset;
+	int32_t w;
+	int32_t h;
+	uint32_t stride;
+	int32_t row;
+	size_t i;
+	FILE* f;
+
+	if(argc != 8)
+	{
+		fprintf(stderr, "Usage: %s <input.bmp> <output.c> <symbol> <x> <y> <clut x> <clut y>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	f = fopen(argv[1], "rb");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, "Could not open \"%s\"!\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	szBmp = fread(bmp, 1, sizeof(bmp), f);
+	fclose(f);
+
+	if(	(szBmp < BMP_HEADER_SIZE + (BMP_PALETTE_COLORS * 4))
+					||
+		(bmp[0] != 'B') || (bmp[1] != 'M')
+					||
+		((bmp[28] | (bmp[29] << 8)) != 4)
+					||
+		(BmpGet32(&bmp[30]) != 0)	)
+	{
+		fprintf(stderr, "\"%s\" is not an uncompressed 4-bit BMP image!\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	offset = BmpGet32(&bmp[10]);
+	w = (int32_t)BmpGet32(&bmp[18]);
+	h = (int32_t)BmpGet32(&bmp[22]);
+	stride = (((w * 4) + 31) / 32) * 4;
+
+	if( (w <= 0) || (h <= 0) || (w % 4) || ((offset + (stride * h)) > szBmp) )
+	{
+		fprintf(stderr, "Unsupported BMP size %dx%d!\n", w, h);
+		return EXIT_FAILURE;
+	}
+
+	TimPut32(TIM_MAGIC);
+	TimPut32(TIM_4BPP_CLUT);
+
+	// CLUT block.
+	TimPut32(TIM_BLOCK_HEADER_SIZE + (BMP_PALETTE_COLORS * 2));
+	TimPut16((uint16_t)atoi(argv[6]));
+	TimPut16((uint16_t)atoi(argv[7]));
+	TimPut16(BMP_PALETTE_COLORS);
+	TimPut16(1);
+
+	for(i = 0; i < BMP_PALETTE_COLORS; i++)
+	{
+		// BMP palette entries are stored as B, G, R, reserved.
+		const uint8_t* c = &bmp[BMP_HEADER_SIZE + (i * 4)];
+
+		TimPut16(TimColor(c[2], c[1], c[0]));
+	}
+
+	// Image block. Width is expressed in 16-bit units.
+	TimPut32(TIM_BLOCK_HEADER_SIZE + ((w / 2) * h));
+	TimPut16((uint16_t)atoi(argv[4]));
+	TimPut16((uint16_t)atoi(argv[5]));
+	TimPut16((uint16_t)(w / 4));
+	TimPut16((uint16_t)h);
+
+	// BMP rows are stored bottom-up, with leftmost pixel on high nibble.
+	for(row = h - 1; row >= 0; row--)
+	{
+		const uint8_t* src = &bmp[offset + (row * stride)];
+		int32_t x;
+
+		for(x = 0; x < (w / 2); x++)
+		{
+			tim[szTim++] = (uint8_t)((src[x] >> 4) | (src[x] << 4));
+		}
+	}
+
+	RleCompress();
+
+	name = strrchr(argv[2], '/');
+	snprintf(header, sizeof(header), "%s", (name != NULL)? (name + 1) : argv[2]);
+	name = strrchr(header, '.');
+
+	if( (name == NULL) || (strcmp(name, ".c") != 0) )
+	{
+		fprintf(stderr, "Output file \"%s\" must have .c extension!\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	name[1] = 'h';
+
+	f = fopen(argv[2], "w");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, "Could not open \"%s\"!\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	fprintf(f, "/* Generated by Tools/BmpToC.c from %s. Do not edit. */\n\n", argv[1]);
+	// Header with same name as output file is expected to declare symbols.
+	fprintf(f, "#include \"%s\"\n\n", header);
+	fprintf(f, "const size_t %sSize = %u;\n", argv[3], (unsigned int)szRle);
+	fprintf(f, "const size_t %sTimSize = %u;\n\n", argv[3], (unsigned int)szTim);
+	fprintf(f, "const uint8_t %s[] =\n{", argv[3]);
+
+	for(i = 0; i < szRle; i++)
+	{
+		fprintf(f, "%s0x%02X,", (i % BYTES_PER_LINE)? " " : "\n\t", rle[i]);
+	}
+
+	fprintf(f, "\n};\n");
+	fclose(f);
+
+	printf("%s: %u bytes, %u compressed\n", argv[3], (unsigned int)szTim, (unsigned int)szRle);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+/* *************************************
+ * 	ChannelDemux: extracts one channel from data sent by OpenSend,
+ * 	either while a PSX-EXE runs in resident mode or as a reply to
+ * 	loader standby commands.
+ *
+ * 	Usage: ChannelDemux <capture.bin> <channel> <output.bin>
+ * 	i.e.: ChannelDemux capture.bin 2 samples.bin
+ *
+ * 	<capture.bin> holds bytes received from serial port, as is.
+ * 	Frames (see Source/Channel.h) are:
+ * 		uint8_t sync (0xA5)
+ * 		uint8_t channel
+ * 		uint8_t sequence (per channel)
+ * 		uint8_t payload length (1-64)
+ * 		Payload
+ * 		uint8_t Fletcher-16 sums (sum1, sum2) of all bytes above,
+ * 		except sync.
+ *
+ * 	Channels are 0 (control), 1 (TTY), 2 (profiler samples) and
+ * 	3 (bulk data: memory, VRAM and trace dumps). Bulk data also
+ * 	holds block checksums, so SerialDump should be used for it.
+ *
+ * 	Payload of frames from <channel> is written to <output.bin>, in
+ * 	order. Corrupted frames are skipped, and gaps in sequence numbers
+ * 	are reported on stderr.
+ * *************************************/
+
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+#define CHANNEL_SYNC 0xA5
+#define CHANNEL_HEADER_SIZE 4
+#define CHANNEL_TRAILER_SIZE 2
+#define CHANNEL_MAX_PAYLOAD 64
+#define CHANNEL_FLETCHER_MOD 255
+
+static int ChannelIsValidFrame(const uint8_t* frame, size_t available)
+{
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+	size_t len;
+	size_t i;
+
+	if(available < (CHANNEL_HEADER_SIZE + CHANNEL_TRAILER_SIZE))
+	{
+		return 0;
+	}
+
+	len = frame[3];
+
+	if( (len == 0) || (len > CHANNEL_MAX_PAYLOAD) )
+	{
+		return 0;
+	}
+
+	if(available < (CHANNEL_HEADER_SIZE + len + CHANNEL_TRAILER_SIZE))
+	{
+		return 0;
+	}
+
+	for(i = 1; i < (CHANNEL_HEADER_SIZE + len); i++)
+	{
+		sum1 = (sum1 + frame[i]) % CHANNEL_FLETCHER_MOD;
+		sum2 = (sum2 + sum1) % CHANNEL_FLETCHER_MOD;
+	}
+
+	return (frame[i] == sum1) && (frame[i + 1] == sum2);
+}
+
+int main(int argc, char* argv[])
+{
+	uint8_t* capture;
+	size_t szCapture;
+	size_t offset;
+	unsigned long nFrames = 0;
+	unsigned long skipped = 0;
+	int expected_sequence = -1;
+	long channel;
+	FILE* f;
+
+	if(argc != 4)
+	{
+		fprintf(stderr, "Usage: %s <capture.bin> <channel> <output.bin>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	channel = strtol(argv[2], NULL, 0);
+
+	f = fopen(argv[1], "rb");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, "Could not open \"%s\"!\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	fseek(f, 0, SEEK_END);
+	szCapture = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	capture = malloc(szCapture);
+
+	if( (capture == NULL) || (fread(capture, 1, szCapture, f) != szCapture) )
+	{
+		fprintf(stderr, "Could not read \"%s\"!\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	fclose(f);
+
+	f = fopen(argv[3], "wb");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, "Could not create \"%s\"!\n", argv[3]);
+		return EXIT_FAILURE;
+	}
+
+	for(offset = 0; offset < szCapture; )
+	{
+		const uint8_t* frame = &capture[offset];
+
+		if( (frame[0] != CHANNEL_SYNC) || !ChannelIsValidFrame(frame, szCapture - offset) )
+		{
+			// Looks for next sync byte.
+			offset++;
+			skipped++;
+			continue;
+		}
+
+		if(frame[1] == channel)
+		{
+			if( (expected_sequence >= 0) && (frame[2] != expected_sequence) )
+			{
+				fprintf(stderr, "Frames lost before offset %lu (sequence %d, expected %d).\n",
+						(unsigned long)offset, frame[2], expected_sequence);
+			}
+
+			expected_sequence = (frame[2] + 1) & 0xFF;
+
+			fwrite(&frame[CHANNEL_HEADER_SIZE], 1, frame[3], f);
+			nFrames++;
+		}
+
+		offset += CHANNEL_HEADER_SIZE + frame[3] + CHANNEL_TRAILER_SIZE;
+	}
+
+	fclose(f);
+	free(capture);
+
+	fprintf(stderr, "%lu frames extracted, %lu bytes skipped.\n", nFrames, skipped);
+
+	return EXIT_SUCCESS;
+}
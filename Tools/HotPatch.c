@@ -0,0 +1,1371 @@
+/* *************************************
+ * 	HotPatch: replaces functions of a PSX-EXE running under OpenSend
+ * 	resident mode with their new versions, without restarting it.
+ *
+ * 	Usage: HotPatch <running.elf> <new.elf> [serial port]
+ * 	i.e.: HotPatch GAME_OLD.elf GAME.elf /dev/ttyUSB0
+ *
+ * 	<running.elf> must be the ELF the running PSX-EXE was made from,
+ * 	and <new.elf> the rebuilt one. Both must be unstripped and linked
+ * 	with -Wl,--emit-relocs (-Wl,-q), so relocations are kept.
+ * 	If serial port is not given, functions to be patched are only
+ * 	listed.
+ *
+ * 	Functions are matched by name (and by source file, for static
+ * 	ones). A function is patched when its code, once relocated to
+ * 	the address of its running version, differs from it.
+ *
+ * 	New code is relocated to the patch area address told by PSX
+ * 	(see ResidentReceivePatches(), Source/Resident.c):
+ * 	*	Branches and jumps inside the function follow it.
+ * 	*	References to other functions and to named data are
+ * 		redirected to their running version, so data layout of
+ * 		running program is kept. Calls to patched functions go
+ * 		through the trampoline installed on their old entry.
+ * 	*	String literals are looked up in running program, or
+ * 		uploaded right after function code otherwise.
+ *
+ * 	Functions referencing something missing from running program
+ * 	(new functions or globals, jump tables, ...) cannot be patched,
+ * 	so nothing is uploaded then.
+ *
+ * 	PSX replies are framed (see Source/Channel.h). CHANNEL_TTY output
+ * 	received meanwhile is written to stdout.
+ * *************************************/
+
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+#define ELF_MAGIC 0x464C457F
+#define ELF_SHT_PROGBITS 1
+#define ELF_SHT_SYMTAB 2
+#define ELF_SHT_NOBITS 8
+#define ELF_SHT_REL 9
+#define ELF_SHF_WRITE 0x1
+#define ELF_SHF_ALLOC 0x2
+#define ELF_SHF_EXECINSTR 0x4
+#define ELF_STT_OBJECT 1
+#define ELF_STT_FUNC 2
+#define ELF_STT_FILE 4
+#define ELF_STB_LOCAL 0
+#define ELF_SH_ENTRY_SIZE 40
+#define ELF_SYM_ENTRY_SIZE 16
+#define ELF_REL_ENTRY_SIZE 8
+
+#define R_MIPS_32 2
+#define R_MIPS_26 4
+#define R_MIPS_HI16 5
+#define R_MIPS_LO16 6
+#define R_MIPS_GPREL16 7
+#define R_MIPS_PC16 10
+
+#define MIPS_J_TARGET_MASK 0x03FFFFFF
+#define MIPS_J_REGION_MASK 0xF0000000
+
+// Must match Source/Resident.h and Source/Serial.h.
+#define RESIDENT_MAGIC_PATCH 0x50
+#define ACK_BYTE 'b'
+#define NACK_BYTE 'n'
+// Must match Source/Resident.c.
+#define RESIDENT_MAX_PATCHES 32
+// Must match Source/Channel.h.
+#define CHANNEL_SYNC 0xA5
+#define CHANNEL_HEADER_SIZE 4
+#define CHANNEL_TRAILER_SIZE 2
+#define CHANNEL_MAX_PAYLOAD 64
+#define CHANNEL_FLETCHER_MOD 255
+#define CHANNEL_CONTROL 0
+#define CHANNEL_TTY 1
+#define CHANNEL_COUNT 4
+#define CHANNEL_MSG_DROPS 'd'
+#define CHANNEL_MSG_DROPS_SIZE 6
+
+#define MAIN_RAM_BASE 0x80000000
+#define MAIN_RAM_SIZE 0x200000
+// Longest string literal copied into patch area.
+#define PATCH_MAX_LITERAL 1024
+#define PATCH_MAX_LITERALS 64
+#define PATCH_MAX_RETRIES 3
+#define SERIAL_REPLY_TIMEOUT_MS 2000
+#define SERIAL_DRAIN_TIMEOUT_MS 100
+#define CONTROL_FIFO_SIZE 4096
+
+/* *************************************
+ * 	Structs and enums
+ * *************************************/
+
+typedef struct t_Symbol
+{
+	uint32_t address;
+	uint32_t size;
+	const char* name;
+	// Source file, for local symbols only. NULL otherwise.
+	const char* file;
+	uint8_t type;
+}TYPE_SYMBOL;
+
+typedef struct t_Reloc
+{
+	uint32_t offset;
+	uint32_t symbol;
+	uint8_t type;
+}TYPE_RELOC;
+
+typedef struct t_Elf
+{
+	const char* path;
+	uint8_t* data;
+	size_t size;
+	uint32_t shoff;
+	uint16_t shnum;
+	TYPE_SYMBOL* symbols;
+	long nSymbols;
+	TYPE_RELOC* relocs;
+	long nRelocs;
+	uint32_t gp;
+}TYPE_ELF;
+
+typedef struct t_Literal
+{
+	uint32_t new_address;
+	uint32_t address;
+}TYPE_LITERAL;
+
+// Function being relocated, plus string literals appended to it.
+typedef struct t_Patch
+{
+	const TYPE_SYMBOL* function;
+	const TYPE_SYMBOL* old_function;
+	uint32_t base;
+	uint8_t* code;
+	uint32_t size;
+	TYPE_LITERAL literals[PATCH_MAX_LITERALS];
+	uint8_t nLiterals;
+}TYPE_PATCH;
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+static TYPE_ELF old_elf;
+static TYPE_ELF new_elf;
+
+// Frame being received and control channel data not consumed yet.
+static uint8_t rx_frame[CHANNEL_HEADER_SIZE + CHANNEL_MAX_PAYLOAD + CHANNEL_TRAILER_SIZE];
+static size_t rx_frame_used;
+static uint8_t control_fifo[CONTROL_FIFO_SIZE];
+static size_t control_used;
+static int control_sequence = -1;
+
+static uint32_t Get32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t Get16(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static void Put32(uint8_t* p, uint32_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+	p[2] = (uint8_t)(value >> 16);
+	p[3] = (uint8_t)(value >> 24);
+}
+
+static uint8_t* FileLoad(const char* path, size_t* size)
+{
+	uint8_t* data;
+	FILE* f = fopen(path, "rb");
+
+	if(f == NULL)
+	{
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	data = malloc(*size + 1);
+
+	if( (data != NULL) && (fread(data, 1, *size, f) != *size) )
+	{
+		free(data);
+		data = NULL;
+	}
+
+	fclose(f);
+
+	return data;
+}
+
+static const uint8_t* ElfSection(const TYPE_ELF* elf, uint32_t index)
+{
+	return &elf->data[elf->shoff + (index * ELF_SH_ENTRY_SIZE)];
+}
+
+/* *******************************************************************
+ *
+ * @name: static int ElfLoad(TYPE_ELF* elf, const char* path)
+ *
+ * @brief:
+ * 	Reads function and object symbols, $gp value and relocations
+ * 	applied to code. Returns 0 on error.
+ *
+ * *******************************************************************/
+
+static int ElfLoad(TYPE_ELF* elf, const char* path)
+{
+	uint16_t i;
+
+	elf->path = path;
+	elf->data = FileLoad(path, &elf->size);
+
+	if( (elf->data == NULL) || (elf->size < 52) || (Get32(elf->data) != ELF_MAGIC) )
+	{
+		fprintf(stderr, "Could not read ELF file \"%s\"!\n", path);
+		return 0;
+	}
+
+	elf->shoff = Get32(&elf->data[32]);
+	elf->shnum = Get16(&elf->data[48]);
+
+	if((elf->shoff + (elf->shnum * ELF_SH_ENTRY_SIZE)) > elf->size)
+	{
+		fprintf(stderr, "\"%s\": invalid section headers!\n", path);
+		return 0;
+	}
+
+	for(i = 0; i < elf->shnum; i++)
+	{
+		const uint8_t* sh = ElfSection(elf, i);
+		uint32_t type = Get32(&sh[4]);
+		uint32_t offset = Get32(&sh[16]);
+		uint32_t size = Get32(&sh[20]);
+		uint32_t j;
+
+		if( (type != ELF_SHT_NOBITS) && ((offset + size) > elf->size) )
+		{
+			fprintf(stderr, "\"%s\": section %u out of file!\n", path, i);
+			return 0;
+		}
+
+		if(type == ELF_SHT_SYMTAB)
+		{
+			const uint8_t* strsh = ElfSection(elf, Get32(&sh[24]));
+			uint32_t stroff = Get32(&strsh[16]);
+			const char* file = NULL;
+
+			elf->symbols = malloc((size / ELF_SYM_ENTRY_SIZE) * sizeof(TYPE_SYMBOL));
+
+			if(elf->symbols == NULL)
+			{
+				return 0;
+			}
+
+			for(j = 0; j < size; j += ELF_SYM_ENTRY_SIZE)
+			{
+				const uint8_t* sym = &elf->data[offset + j];
+				const char* name = (const char*)&elf->data[stroff + Get32(&sym[0])];
+				uint8_t sym_type = sym[12] & 0xF;
+				TYPE_SYMBOL* symbol;
+
+				if(sym_type == ELF_STT_FILE)
+				{
+					// Local symbols which follow belong to this file.
+					file = name;
+					continue;
+				}
+
+				if(strcmp(name, "_gp") == 0)
+				{
+					elf->gp = Get32(&sym[4]);
+					continue;
+				}
+
+				if(	((sym_type != ELF_STT_FUNC) && (sym_type != ELF_STT_OBJECT))
+							||
+					(name[0] == '\0')	)
+				{
+					continue;
+				}
+
+				symbol = &elf->symbols[elf->nSymbols++];
+				symbol->address = Get32(&sym[4]);
+				symbol->size = Get32(&sym[8]);
+				symbol->name = name;
+				symbol->file = ((sym[12] >> 4) == ELF_STB_LOCAL)? file : NULL;
+				symbol->type = sym_type;
+			}
+		}
+		else if(type == ELF_SHT_REL)
+		{
+			// sh_info: section relocations are applied to.
+			const uint8_t* target = ElfSection(elf, Get32(&sh[28]));
+			TYPE_RELOC* relocs;
+
+			if(!(Get32(&target[8]) & ELF_SHF_EXECINSTR))
+			{
+				continue;
+			}
+
+			relocs = realloc(elf->relocs, (elf->nRelocs + (size / ELF_REL_ENTRY_SIZE)) * sizeof(TYPE_RELOC));
+
+			if(relocs == NULL)
+			{
+				return 0;
+			}
+
+			elf->relocs = relocs;
+
+			// File order is kept, since HI16 relocations are paired
+			// with LO16 relocations following them.
+			for(j = 0; j < size; j += ELF_REL_ENTRY_SIZE)
+			{
+				const uint8_t* rel = &elf->data[offset + j];
+				TYPE_RELOC* reloc = &elf->relocs[elf->nRelocs++];
+
+				// Final address, since file is an executable.
+				reloc->offset = Get32(&rel[0]);
+				reloc->symbol = Get32(&rel[4]) >> 8;
+				reloc->type = rel[4];
+			}
+		}
+	}
+
+	if(elf->symbols == NULL)
+	{
+		fprintf(stderr, "No symbol table found on \"%s\"!\n", path);
+		return 0;
+	}
+
+	if(elf->relocs == NULL)
+	{
+		fprintf(stderr, "No relocations found on \"%s\". Link it with -Wl,--emit-relocs.\n", path);
+		return 0;
+	}
+
+	return 1;
+}
+
+// Returns file data at "address" and bytes left on its section,
+// or NULL if "address" is not initialized by file.
+static const uint8_t* ElfData(const TYPE_ELF* elf, uint32_t address, uint32_t* available, uint32_t* flags)
+{
+	uint16_t i;
+
+	for(i = 0; i < elf->shnum; i++)
+	{
+		const uint8_t* sh = ElfSection(elf, i);
+		uint32_t sh_addr = Get32(&sh[12]);
+		uint32_t sh_size = Get32(&sh[20]);
+
+		if(	(Get32(&sh[4]) != ELF_SHT_PROGBITS)
+					||
+			!(Get32(&sh[8]) & ELF_SHF_ALLOC)
+					||
+			(address < sh_addr)
+					||
+			(address >= (sh_addr + sh_size))	)
+		{
+			continue;
+		}
+
+		*available = sh_addr + sh_size - address;
+
+		if(flags != NULL)
+		{
+			*flags = Get32(&sh[8]);
+		}
+
+		return &elf->data[Get32(&sh[16]) + (address - sh_addr)];
+	}
+
+	return NULL;
+}
+
+static const TYPE_SYMBOL* SymbolFindByName(const TYPE_ELF* elf, const TYPE_SYMBOL* symbol)
+{
+	long i;
+
+	for(i = 0; i < elf->nSymbols; i++)
+	{
+		const TYPE_SYMBOL* s = &elf->symbols[i];
+
+		if(	(s->type == symbol->type)
+					&&
+			(strcmp(s->name, symbol->name) == 0)
+					&&
+			((s->file == symbol->file) || ((s->file != NULL) && (symbol->file != NULL) && (strcmp(s->file, symbol->file) == 0)))	)
+		{
+			return s;
+		}
+	}
+
+	return NULL;
+}
+
+static const TYPE_SYMBOL* SymbolFindByAddress(const TYPE_ELF* elf, uint32_t address)
+{
+	long i;
+
+	for(i = 0; i < elf->nSymbols; i++)
+	{
+		const TYPE_SYMBOL* s = &elf->symbols[i];
+
+		if(	(address == s->address)
+					||
+			((address > s->address) && (address < (s->address + s->size)))	)
+		{
+			return s;
+		}
+	}
+
+	return NULL;
+}
+
+// Two buffers, so it can be used twice on the same fprintf() call.
+static const char* SymbolDescribe(const TYPE_SYMBOL* symbol)
+{
+	static char text[2][256];
+	static uint8_t index;
+
+	index ^= 1;
+
+	if(symbol->file != NULL)
+	{
+		snprintf(text[index], sizeof(text[index]), "%s (%s)", symbol->name, symbol->file);
+	}
+	else
+	{
+		snprintf(text[index], sizeof(text[index]), "%s", symbol->name);
+	}
+
+	return text[index];
+}
+
+/* *******************************************************************
+ *
+ * @name: static int PatchFindLiteral(TYPE_PATCH* patch, uint32_t address, uint32_t* old_address)
+ *
+ * @brief:
+ * 	Maps a NUL-terminated string from read-only data of new ELF to
+ * 	an identical one in running program, or else appends it to
+ * 	patch, after function code. Returns 0 if "address" does not
+ * 	hold a string.
+ *
+ * *******************************************************************/
+
+static int PatchFindLiteral(TYPE_PATCH* patch, uint32_t address, uint32_t* old_address)
+{
+	const uint8_t* data;
+	uint32_t available;
+	uint32_t flags;
+	uint32_t length;
+	uint16_t i;
+	uint8_t* code;
+
+	for(i = 0; i < patch->nLiterals; i++)
+	{
+		if(patch->literals[i].new_address == address)
+		{
+			*old_address = patch->literals[i].address;
+			return 1;
+		}
+	}
+
+	data = ElfData(&new_elf, address, &available, &flags);
+
+	if( (data == NULL) || (flags & (ELF_SHF_WRITE | ELF_SHF_EXECINSTR)) || (patch->nLiterals >= PATCH_MAX_LITERALS) )
+	{
+		return 0;
+	}
+
+	for(length = 0; (length < available) && (length < PATCH_MAX_LITERAL) && (data[length] != '\0'); length++);
+
+	if( (length == available) || (length == PATCH_MAX_LITERAL) )
+	{
+		return 0;
+	}
+
+	// NUL terminator is compared too.
+	length++;
+
+	for(i = 0; i < old_elf.shnum; i++)
+	{
+		const uint8_t* sh = ElfSection(&old_elf, i);
+		const uint8_t* old_data = &old_elf.data[Get32(&sh[16])];
+		uint32_t sh_size = Get32(&sh[20]);
+		// Alignment is kept, since strings might be copied by words.
+		uint32_t step = (address & 3)? 1 : 4;
+		uint32_t offset;
+
+		if(	(Get32(&sh[4]) != ELF_SHT_PROGBITS)
+					||
+			((Get32(&sh[8]) & (ELF_SHF_ALLOC | ELF_SHF_WRITE | ELF_SHF_EXECINSTR)) != ELF_SHF_ALLOC)
+					||
+			(sh_size < length)	)
+		{
+			continue;
+		}
+
+		for(offset = (step - (Get32(&sh[12]) & (step - 1))) & (step - 1); offset <= (sh_size - length); offset += step)
+		{
+			if(memcmp(&old_data[offset], data, length) == 0)
+			{
+				*old_address = Get32(&sh[12]) + offset;
+				patch->literals[patch->nLiterals].new_address = address;
+				patch->literals[patch->nLiterals].address = *old_address;
+				patch->nLiterals++;
+				return 1;
+			}
+		}
+	}
+
+	code = realloc(patch->code, ((patch->size + 3) & ~3) + length);
+
+	if(code == NULL)
+	{
+		return 0;
+	}
+
+	patch->code = code;
+	patch->size = (patch->size + 3) & ~3;
+	memcpy(&patch->code[patch->size], data, length);
+
+	*old_address = patch->base + patch->size;
+	patch->size += length;
+
+	patch->literals[patch->nLiterals].new_address = address;
+	patch->literals[patch->nLiterals].address = *old_address;
+	patch->nLiterals++;
+
+	return 1;
+}
+
+/* *******************************************************************
+ *
+ * @name: static int PatchMapAddress(TYPE_PATCH* patch, uint32_t address, uint32_t* old_address)
+ *
+ * @brief:
+ * 	Translates an address referenced by new function code into the
+ * 	address it must reference once placed at patch->base, inside
+ * 	running program. Returns 0 if there is no such address.
+ *
+ * *******************************************************************/
+
+static int PatchMapAddress(TYPE_PATCH* patch, uint32_t address, uint32_t* old_address)
+{
+	const TYPE_SYMBOL* function = patch->function;
+	const TYPE_SYMBOL* symbol;
+	const TYPE_SYMBOL* old_symbol;
+	uint32_t offset;
+
+	if( (address >= function->address) && (address < (function->address + function->size)) )
+	{
+		*old_address = patch->base + (address - function->address);
+		return 1;
+	}
+
+	symbol = SymbolFindByAddress(&new_elf, address);
+
+	if(symbol == NULL)
+	{
+		if(PatchFindLiteral(patch, address, old_address) != 0)
+		{
+			return 1;
+		}
+
+		fprintf(stderr, "%s: references unnamed address 0x%08X (jump table?).\n",
+				SymbolDescribe(function), address);
+		return 0;
+	}
+
+	old_symbol = SymbolFindByName(&old_elf, symbol);
+	offset = address - symbol->address;
+
+	if(old_symbol == NULL)
+	{
+		fprintf(stderr, "%s: references %s, missing from running program.\n",
+				SymbolDescribe(function), SymbolDescribe(symbol));
+		return 0;
+	}
+
+	// Functions are only entered through their entry point, where
+	// trampolines are installed.
+	if( ((symbol->type == ELF_STT_FUNC) && (offset != 0)) || (offset > old_symbol->size) )
+	{
+		fprintf(stderr, "%s: references %s+%u, not valid on running program.\n",
+				SymbolDescribe(function), SymbolDescribe(symbol), offset);
+		return 0;
+	}
+
+	*old_address = old_symbol->address + offset;
+
+	return 1;
+}
+
+// Looks for LO16 relocation paired with HI16 relocation "index".
+static const TYPE_RELOC* PatchFindLo16(const TYPE_RELOC* hi, long index)
+{
+	long i;
+
+	for(i = index + 1; i < new_elf.nRelocs; i++)
+	{
+		const TYPE_RELOC* reloc = &new_elf.relocs[i];
+
+		if( (reloc->type == R_MIPS_LO16) && (reloc->symbol == hi->symbol) )
+		{
+			return reloc;
+		}
+	}
+
+	return NULL;
+}
+
+// Looks for HI16 relocation which LO16 relocation "index" belongs to.
+static const TYPE_RELOC* PatchFindHi16(const TYPE_RELOC* lo, long index)
+{
+	long i;
+
+	for(i = index - 1; i >= 0; i--)
+	{
+		const TYPE_RELOC* reloc = &new_elf.relocs[i];
+
+		if( (reloc->type == R_MIPS_HI16) && (reloc->symbol == lo->symbol) )
+		{
+			return reloc;
+		}
+	}
+
+	return NULL;
+}
+
+/* *******************************************************************
+ *
+ * @name: static int PatchRelocate(TYPE_PATCH* patch)
+ *
+ * @brief:
+ * 	Copies new function code into patch->code and applies its
+ * 	relocations again, as if it had been linked at patch->base
+ * 	against running program. Returns 0 on error.
+ *
+ * *******************************************************************/
+
+static int PatchRelocate(TYPE_PATCH* patch)
+{
+	const TYPE_SYMBOL* function = patch->function;
+	uint32_t available;
+	const uint8_t* src = ElfData(&new_elf, function->address, &available, NULL);
+	long i;
+
+	if( (src == NULL) || (available < function->size) )
+	{
+		fprintf(stderr, "%s: code not found.\n", SymbolDescribe(function));
+		return 0;
+	}
+
+	patch->size = function->size;
+	patch->nLiterals = 0;
+	patch->code = malloc(patch->size + 4);
+
+	if(patch->code == NULL)
+	{
+		return 0;
+	}
+
+	memcpy(patch->code, src, patch->size);
+
+	for(i = 0; i < new_elf.nRelocs; i++)
+	{
+		const TYPE_RELOC* reloc = &new_elf.relocs[i];
+		uint32_t offset = reloc->offset - function->address;
+		uint32_t pc = patch->base + offset;
+		uint32_t insn;
+		uint32_t target;
+		uint32_t old_target;
+
+		if( (reloc->offset < function->address) || (offset >= function->size) )
+		{
+			continue;
+		}
+
+		// Relocations are computed from original code, since HI16
+		// and LO16 fields of other instructions are read.
+		insn = Get32(&src[offset]);
+
+		switch(reloc->type)
+		{
+			case R_MIPS_32:
+				if(PatchMapAddress(patch, insn, &old_target) == 0)
+				{
+					return 0;
+				}
+
+				insn = old_target;
+			break;
+
+			case R_MIPS_26:
+				target = ((reloc->offset + 4) & MIPS_J_REGION_MASK) | ((insn & MIPS_J_TARGET_MASK) << 2);
+
+				if(PatchMapAddress(patch, target, &old_target) == 0)
+				{
+					return 0;
+				}
+
+				if((old_target & MIPS_J_REGION_MASK) != ((pc + 4) & MIPS_J_REGION_MASK))
+				{
+					fprintf(stderr, "%s: jump target 0x%08X out of range.\n", SymbolDescribe(function), old_target);
+					return 0;
+				}
+
+				insn = (insn & ~MIPS_J_TARGET_MASK) | ((old_target >> 2) & MIPS_J_TARGET_MASK);
+			break;
+
+			case R_MIPS_HI16:
+				// Fall through.
+			case R_MIPS_LO16:
+			{
+				const TYPE_RELOC* hi = (reloc->type == R_MIPS_HI16)? reloc : PatchFindHi16(reloc, i);
+				const TYPE_RELOC* lo = (reloc->type == R_MIPS_LO16)? reloc : PatchFindLo16(reloc, i);
+				uint32_t hi_offset;
+				uint32_t lo_offset;
+
+				if( (hi == NULL) || (lo == NULL) )
+				{
+					fprintf(stderr, "%s: unpaired HI16/LO16 relocation at 0x%08X.\n",
+							SymbolDescribe(function), reloc->offset);
+					return 0;
+				}
+
+				hi_offset = hi->offset - function->address;
+				lo_offset = lo->offset - function->address;
+
+				if( (hi->offset < function->address) || (hi_offset >= function->size)
+								||
+					(lo->offset < function->address) || (lo_offset >= function->size) )
+				{
+					fprintf(stderr, "%s: HI16/LO16 pair crosses function boundary.\n", SymbolDescribe(function));
+					return 0;
+				}
+
+				target = (Get32(&src[hi_offset]) << 16) + (int16_t)Get32(&src[lo_offset]);
+
+				if(PatchMapAddress(patch, target, &old_target) == 0)
+				{
+					return 0;
+				}
+
+				if(reloc->type == R_MIPS_HI16)
+				{
+					insn = (insn & 0xFFFF0000) | (((old_target + 0x8000) >> 16) & 0xFFFF);
+				}
+				else
+				{
+					insn = (insn & 0xFFFF0000) | (old_target & 0xFFFF);
+				}
+			}
+			break;
+
+			case R_MIPS_GPREL16:
+			{
+				int32_t displacement;
+
+				target = new_elf.gp + (int16_t)insn;
+
+				if(PatchMapAddress(patch, target, &old_target) == 0)
+				{
+					return 0;
+				}
+
+				displacement = (int32_t)(old_target - old_elf.gp);
+
+				if( (displacement < INT16_MIN) || (displacement > INT16_MAX) )
+				{
+					fprintf(stderr, "%s: 0x%08X out of $gp range.\n", SymbolDescribe(function), old_target);
+					return 0;
+				}
+
+				insn = (insn & 0xFFFF0000) | ((uint32_t)displacement & 0xFFFF);
+			}
+			break;
+
+			case R_MIPS_PC16:
+			{
+				int32_t displacement;
+
+				target = reloc->offset + 4 + ((int32_t)(int16_t)insn << 2);
+
+				if(PatchMapAddress(patch, target, &old_target) == 0)
+				{
+					return 0;
+				}
+
+				displacement = (int32_t)(old_target - (pc + 4)) >> 2;
+
+				if( (displacement < INT16_MIN) || (displacement > INT16_MAX) )
+				{
+					fprintf(stderr, "%s: branch target 0x%08X out of range.\n", SymbolDescribe(function), old_target);
+					return 0;
+				}
+
+				insn = (insn & 0xFFFF0000) | ((uint32_t)displacement & 0xFFFF);
+			}
+			break;
+
+			default:
+				fprintf(stderr, "%s: unsupported relocation type %u at 0x%08X.\n",
+						SymbolDescribe(function), reloc->type, reloc->offset);
+			return 0;
+		}
+
+		Put32(&patch->code[offset], insn);
+	}
+
+	return 1;
+}
+
+// Returns 1 if "function" code differs from running version.
+static int PatchIsChanged(const TYPE_SYMBOL* function, const TYPE_SYMBOL* old_function, int* error)
+{
+	TYPE_PATCH patch = {.function = function, .old_function = old_function, .base = old_function->address};
+	uint32_t available;
+	const uint8_t* old_code = ElfData(&old_elf, old_function->address, &available, NULL);
+	int changed;
+
+	*error = 0;
+
+	if(PatchRelocate(&patch) == 0)
+	{
+		free(patch.code);
+		*error = 1;
+		return 1;
+	}
+
+	// Appended literals also mean a change, since size grows.
+	changed = 	(patch.size != old_function->size)
+					||
+				(old_code == NULL)
+					||
+				(available < old_function->size)
+					||
+				(memcmp(patch.code, old_code, patch.size) != 0);
+
+	free(patch.code);
+
+	return changed;
+}
+
+static uint32_t Adler32(const uint8_t* data, size_t size)
+{
+	uint32_t a = 1;
+	uint32_t b = 0;
+	size_t i;
+
+	for(i = 0; i < size; i++)
+	{
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	return (b << 16) | a;
+}
+
+static int SerialOpen(const char* port)
+{
+	struct termios tty;
+	int fd = open(port, O_RDWR | O_NOCTTY);
+
+	if(fd < 0)
+	{
+		return -1;
+	}
+
+	if(tcgetattr(fd, &tty) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	cfmakeraw(&tty);
+	cfsetispeed(&tty, B115200);
+	cfsetospeed(&tty, B115200);
+	tty.c_cflag |= CLOCAL | CREAD;
+	tty.c_cc[VMIN] = 0;
+	tty.c_cc[VTIME] = 0;
+
+	if(tcsetattr(fd, TCSANOW, &tty) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	tcflush(fd, TCIOFLUSH);
+
+	return fd;
+}
+
+static int SerialWrite(int fd, const void* data, size_t size)
+{
+	const uint8_t* p = data;
+
+	while(size != 0)
+	{
+		ssize_t written = write(fd, p, size);
+
+		if(written <= 0)
+		{
+			return 0;
+		}
+
+		p += written;
+		size -= written;
+	}
+
+	return tcdrain(fd) == 0;
+}
+
+static int SerialWriteWord(int fd, uint32_t word)
+{
+	uint8_t bytes[sizeof(uint32_t)];
+
+	Put32(bytes, word);
+
+	return SerialWrite(fd, bytes, sizeof(bytes));
+}
+
+static int ChannelIsValidFrame(const uint8_t* frame, size_t size)
+{
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+	size_t i;
+
+	for(i = 1; i < (size - CHANNEL_TRAILER_SIZE); i++)
+	{
+		sum1 = (sum1 + frame[i]) % CHANNEL_FLETCHER_MOD;
+		sum2 = (sum2 + sum1) % CHANNEL_FLETCHER_MOD;
+	}
+
+	return (frame[i] == sum1) && (frame[i + 1] == sum2);
+}
+
+static void ChannelDispatch(const uint8_t* frame)
+{
+	const uint8_t* payload = &frame[CHANNEL_HEADER_SIZE];
+	uint8_t len = frame[3];
+
+	if(frame[1] == CHANNEL_TTY)
+	{
+		fwrite(payload, 1, len, stdout);
+		fflush(stdout);
+	}
+	else if(frame[1] == CHANNEL_CONTROL)
+	{
+		if( (control_sequence >= 0) && (frame[2] != control_sequence) )
+		{
+			fprintf(stderr, "Control frames lost!\n");
+		}
+
+		control_sequence = (frame[2] + 1) & 0xFF;
+
+		if((control_used + len) <= sizeof(control_fifo))
+		{
+			memcpy(&control_fifo[control_used], payload, len);
+			control_used += len;
+		}
+	}
+}
+
+// Looks for a complete frame on received bytes, resynchronizing on
+// next sync byte when received data is not a valid frame.
+static void ChannelReceiveByte(uint8_t byte)
+{
+	rx_frame[rx_frame_used++] = byte;
+
+	while(rx_frame_used != 0)
+	{
+		size_t frame_size;
+		size_t skip;
+
+		if(rx_frame[0] != CHANNEL_SYNC)
+		{
+			skip = 1;
+		}
+		else if(rx_frame_used < CHANNEL_HEADER_SIZE)
+		{
+			return;
+		}
+		else if( (rx_frame[3] == 0) || (rx_frame[3] > CHANNEL_MAX_PAYLOAD) || (rx_frame[1] >= CHANNEL_COUNT) )
+		{
+			skip = 1;
+		}
+		else
+		{
+			frame_size = CHANNEL_HEADER_SIZE + rx_frame[3] + CHANNEL_TRAILER_SIZE;
+
+			if(rx_frame_used < frame_size)
+			{
+				return;
+			}
+
+			if(ChannelIsValidFrame(rx_frame, frame_size))
+			{
+				ChannelDispatch(rx_frame);
+				skip = frame_size;
+			}
+			else
+			{
+				skip = 1;
+			}
+		}
+
+		rx_frame_used -= skip;
+		memmove(rx_frame, &rx_frame[skip], rx_frame_used);
+	}
+}
+
+// Waits up to "timeout_ms" for data and processes it. Returns 0 on timeout.
+static int ChannelReceive(int fd, int timeout_ms)
+{
+	uint8_t buffer[256];
+	struct timeval tv = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+	fd_set set;
+	ssize_t received;
+	ssize_t i;
+
+	FD_ZERO(&set);
+	FD_SET(fd, &set);
+
+	if(select(fd + 1, &set, NULL, NULL, &tv) <= 0)
+	{
+		return 0;
+	}
+
+	received = read(fd, buffer, sizeof(buffer));
+
+	for(i = 0; i < received; i++)
+	{
+		ChannelReceiveByte(buffer[i]);
+	}
+
+	return 1;
+}
+
+/* *******************************************************************
+ *
+ * @name: static int ControlRead(int fd, uint8_t* dst, size_t n, int timeout_ms)
+ *
+ * @brief:
+ * 	Receives frames until "n" control channel bytes are available,
+ * 	and moves them into "dst". Returns 0 on timeout.
+ *
+ * *******************************************************************/
+
+static int ControlRead(int fd, uint8_t* dst, size_t n, int timeout_ms)
+{
+	while(control_used < n)
+	{
+		if(ChannelReceive(fd, timeout_ms) == 0)
+		{
+			return 0;
+		}
+	}
+
+	memcpy(dst, control_fifo, n);
+
+	control_used -= n;
+	memmove(control_fifo, &control_fifo[n], control_used);
+
+	return 1;
+}
+
+// Waits for ACK or NACK. Drop reports, which can be queued on control
+// channel before any reply, are skipped.
+static int ControlReadAnswer(int fd, int timeout_ms, uint8_t* answer)
+{
+	while(ControlRead(fd, answer, sizeof(uint8_t), timeout_ms) != 0)
+	{
+		uint8_t report[CHANNEL_MSG_DROPS_SIZE - 1];
+
+		if(*answer != CHANNEL_MSG_DROPS)
+		{
+			return 1;
+		}
+
+		if(ControlRead(fd, report, sizeof(report), timeout_ms) == 0)
+		{
+			return 0;
+		}
+
+		fprintf(stderr, "%u bytes dropped from channel %u.\n", Get32(&report[1]), report[0]);
+	}
+
+	return 0;
+}
+
+static int PatchUpload(int fd, TYPE_PATCH* patches, uint32_t nPatches)
+{
+	uint8_t header[2 * sizeof(uint32_t)];
+	uint8_t command = RESIDENT_MAGIC_PATCH;
+	uint8_t answer;
+	uint32_t base;
+	uint32_t free_bytes;
+	uint32_t used = 0;
+	uint32_t i;
+
+	// Output already sent by running program is consumed first, so
+	// it is not mistaken for a reply.
+	while(ChannelReceive(fd, SERIAL_DRAIN_TIMEOUT_MS) != 0);
+
+	control_used = 0;
+
+	if( (SerialWrite(fd, &command, sizeof(command)) == 0)
+					||
+		(ControlRead(fd, header, sizeof(header), SERIAL_REPLY_TIMEOUT_MS) == 0) )
+	{
+		fprintf(stderr, "PSX did not answer. Is PSX-EXE running in resident mode?\n");
+		return 0;
+	}
+
+	base = Get32(&header[0]);
+	free_bytes = Get32(&header[4]);
+
+	if( (base < MAIN_RAM_BASE) || (base >= (MAIN_RAM_BASE + MAIN_RAM_SIZE)) || (base & 3) )
+	{
+		fprintf(stderr, "Unexpected patch area address 0x%08X!\n", base);
+		return 0;
+	}
+
+	printf("Patch area: 0x%08X, %u bytes free.\n", base, free_bytes);
+
+	for(i = 0; i < nPatches; i++)
+	{
+		patches[i].base = base + used;
+
+		if(PatchRelocate(&patches[i]) == 0)
+		{
+			break;
+		}
+
+		used += (patches[i].size + 3) & ~3;
+	}
+
+	if( (i != nPatches) || (used > free_bytes) )
+	{
+		if(used > free_bytes)
+		{
+			fprintf(stderr, "%u bytes needed, but only %u bytes are free!\n", used, free_bytes);
+		}
+
+		// PSX waits for number of functions, so it is told there are none.
+		SerialWriteWord(fd, 0);
+		return 0;
+	}
+
+	SerialWriteWord(fd, nPatches);
+
+	if(ControlReadAnswer(fd, SERIAL_REPLY_TIMEOUT_MS, &answer) == 0)
+	{
+		fprintf(stderr, "PSX did not answer to number of patches!\n");
+		return 0;
+	}
+	else if(answer != ACK_BYTE)
+	{
+		fprintf(stderr, "PSX rejected %u patches (%d at most, including pending ones).\n",
+				nPatches, RESIDENT_MAX_PATCHES);
+		return 0;
+	}
+
+	for(i = 0; i < nPatches; i++)
+	{
+		const TYPE_PATCH* patch = &patches[i];
+		uint8_t retries;
+
+		for(retries = 0; retries < PATCH_MAX_RETRIES; retries++)
+		{
+			if(	(SerialWriteWord(fd, patch->old_function->address) == 0)
+						||
+				(SerialWriteWord(fd, patch->size) == 0)
+						||
+				(SerialWrite(fd, patch->code, patch->size) == 0)
+						||
+				(SerialWriteWord(fd, Adler32(patch->code, patch->size)) == 0)
+						||
+				(ControlReadAnswer(fd, SERIAL_REPLY_TIMEOUT_MS, &answer) == 0)	)
+			{
+				fprintf(stderr, "Serial transfer failed!\n");
+				return 0;
+			}
+
+			if(answer == ACK_BYTE)
+			{
+				break;
+			}
+			else if(answer != NACK_BYTE)
+			{
+				fprintf(stderr, "Unexpected answer 0x%02X!\n", answer);
+				return 0;
+			}
+		}
+
+		if(retries == PATCH_MAX_RETRIES)
+		{
+			fprintf(stderr, "%s could not be sent!\n", SymbolDescribe(patch->function));
+			return 0;
+		}
+
+		printf("%s: 0x%08X -> 0x%08X, %u bytes.\n", SymbolDescribe(patch->function),
+				patch->old_function->address, patch->base, patch->size);
+	}
+
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	TYPE_PATCH* patches;
+	uint32_t nPatches = 0;
+	int errors = 0;
+	int result = EXIT_SUCCESS;
+	long i;
+
+	if( (argc != 3) && (argc != 4) )
+	{
+		fprintf(stderr, "Usage: %s <running.elf> <new.elf> [serial port]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if( (ElfLoad(&old_elf, argv[1]) == 0) || (ElfLoad(&new_elf, argv[2]) == 0) )
+	{
+		return EXIT_FAILURE;
+	}
+
+	patches = calloc(new_elf.nSymbols + 1, sizeof(TYPE_PATCH));
+
+	if(patches == NULL)
+	{
+		fprintf(stderr, "Out of memory!\n");
+		return EXIT_FAILURE;
+	}
+
+	for(i = 0; i < new_elf.nSymbols; i++)
+	{
+		const TYPE_SYMBOL* function = &new_elf.symbols[i];
+		const TYPE_SYMBOL* old_function;
+		int error;
+
+		if(function->type != ELF_STT_FUNC)
+		{
+			continue;
+		}
+
+		old_function = SymbolFindByName(&old_elf, function);
+
+		if(old_function == NULL)
+		{
+			// Only an error if called from a patched function.
+			continue;
+		}
+
+		if(PatchIsChanged(function, old_function, &error) == 0)
+		{
+			continue;
+		}
+
+		if(old_function->size < 8)
+		{
+			fprintf(stderr, "%s: too small for a trampoline.\n", SymbolDescribe(function));
+			error = 1;
+		}
+
+		errors += error;
+
+		patches[nPatches].function = function;
+		patches[nPatches].old_function = old_function;
+		nPatches++;
+	}
+
+	for(i = 0; i < new_elf.nSymbols; i++)
+	{
+		const TYPE_SYMBOL* object = &new_elf.symbols[i];
+		const TYPE_SYMBOL* old_object;
+
+		if(object->type != ELF_STT_OBJECT)
+		{
+			continue;
+		}
+
+		old_object = SymbolFindByName(&old_elf, object);
+
+		if( (old_object != NULL) && (old_object->size != object->size) )
+		{
+			fprintf(stderr, "Warning: size of %s changed, running program keeps old one.\n",
+					SymbolDescribe(object));
+		}
+	}
+
+	printf("%u functions changed.\n", nPatches);
+
+	if(errors != 0)
+	{
+		fprintf(stderr, "%d functions cannot be patched. Nothing sent.\n", errors);
+		return EXIT_FAILURE;
+	}
+
+	if(nPatches > RESIDENT_MAX_PATCHES)
+	{
+		fprintf(stderr, "At most %d functions can be patched at once!\n", RESIDENT_MAX_PATCHES);
+		return EXIT_FAILURE;
+	}
+
+	if(argc == 3)
+	{
+		for(i = 0; i < (long)nPatches; i++)
+		{
+			printf("%s\n", SymbolDescribe(patches[i].function));
+		}
+	}
+	else if(nPatches != 0)
+	{
+		int fd = SerialOpen(argv[3]);
+
+		if(fd < 0)
+		{
+			fprintf(stderr, "Could not open \"%s\"!\n", argv[3]);
+			return EXIT_FAILURE;
+		}
+
+		if(PatchUpload(fd, patches, nPatches) == 0)
+		{
+			result = EXIT_FAILURE;
+		}
+
+		close(fd);
+	}
+
+	for(i = 0; i < (long)nPatches; i++)
+	{
+		free(patches[i].code);
+	}
+
+	free(patches);
+
+	return result;
+}
@@ -0,0 +1,258 @@
+/* *************************************
+ * 	PackData: builds OpenSend asset archive.
+ *
+ * 	Usage: PackData <root dir> <data dir> <output file>
+ * 	i.e.: PackData ../cdimg DATA ../cdimg/DATA.PAK
+ *
+ * 	Every file found under <root dir>/<data dir> is stored in
+ * 	<output file>, sector-aligned, after an index sorted by name
+ * 	so OpenSend can look files up without walking ISO9660
+ * 	directories. Names are stored as on the disc, without "cdrom:"
+ * 	prefix and version suffix, i.e.: "DATA\FONTS\FONT_2.FNT".
+ *
+ * 	Archive layout (little-endian):
+ * 		uint32_t magic ("OSPK")
+ * 		uint32_t number of entries
+ * 		Entries: char name[24], uint32_t sector, uint32_t size
+ * 		File data, each file starting on a new 2048-byte sector.
+ * 	Sectors are relative to archive start.
+ * *************************************/
+
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+#define ARCHIVE_MAGIC 0x4B50534F
+#define ARCHIVE_NAME_SIZE 24
+#define ARCHIVE_ENTRY_SIZE (ARCHIVE_NAME_SIZE + 8)
+#define ARCHIVE_HEADER_SIZE 8
+#define SECTOR_SIZE 2048
+#define MAX_FILES 256
+#define MAX_PATH_LENGTH 512
+
+/* *************************************
+ * 	Structs and enums
+ * *************************************/
+
+typedef struct t_PackEntry
+{
+	char name[ARCHIVE_NAME_SIZE];
+	char path[MAX_PATH_LENGTH];
+	uint32_t sector;
+	uint32_t size;
+}TYPE_PACK_ENTRY;
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+static TYPE_PACK_ENTRY entries[MAX_FILES];
+static uint32_t nEntries;
+
+static int PackCompareEntries(const void* a, const void* b)
+{
+	return strcmp(	((const TYPE_PACK_ENTRY*)a)->name,
+					((const TYPE_PACK_ENTRY*)b)->name	);
+}
+
+static void PackWrite32(FILE* f, uint32_t value)
+{
+	uint8_t data[4];
+
+	data[0] = (uint8_t)value;
+	data[1] = (uint8_t)(value >> 8);
+	data[2] = (uint8_t)(value >> 16);
+	data[3] = (uint8_t)(value >> 24);
+
+	fwrite(data, sizeof(data), 1, f);
+}
+
+static void PackPad(FILE* f)
+{
+	while(ftell(f) % SECTOR_SIZE)
+	{
+		fputc(0, f);
+	}
+}
+
+/* *******************************************************************
+ *
+ * @name: static int PackScanDir(const char* dir, const char* name)
+ *
+ * @brief:
+ * 	Recursively adds all files inside "dir" to entries table.
+ * 	"name" is the disc path matching "dir" (i.e.: "DATA\FONTS").
+ *
+ * *******************************************************************/
+
+static int PackScanDir(const char* dir, const char* name)
+{
+	DIR* d = opendir(dir);
+	struct dirent* ent;
+
+	if(d == NULL)
+	{
+		fprintf(stderr, "Could not open directory \"%s\"!\n", dir);
+		return -1;
+	}
+
+	while( (ent = readdir(d)) != NULL)
+	{
+		char path[MAX_PATH_LENGTH];
+		char disc_name[MAX_PATH_LENGTH];
+		struct stat st;
+		size_t i;
+
+		if(ent->d_name[0] == '.')
+		{
+			continue;
+		}
+
+		snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+		snprintf(disc_name, sizeof(disc_name), "%s\\%s", name, ent->d_name);
+
+		// ISO9660 names are uppercase.
+		for(i = 0; disc_name[i] != '\0'; i++)
+		{
+			disc_name[i] = toupper((unsigned char)disc_name[i]);
+		}
+
+		if(stat(path, &st) != 0)
+		{
+			fprintf(stderr, "Could not stat \"%s\"!\n", path);
+			closedir(d);
+			return -1;
+		}
+
+		if(S_ISDIR(st.st_mode))
+		{
+			if(PackScanDir(path, disc_name) != 0)
+			{
+				closedir(d);
+				return -1;
+			}
+		}
+		else if(S_ISREG(st.st_mode))
+		{
+			TYPE_PACK_ENTRY* e;
+
+			if(nEntries >= MAX_FILES)
+			{
+				fprintf(stderr, "Too many files (max %d)!\n", MAX_FILES);
+				closedir(d);
+				return -1;
+			}
+
+			if(strlen(disc_name) >= ARCHIVE_NAME_SIZE)
+			{
+				fprintf(stderr, "Name \"%s\" is too long (max %d characters)!\n",
+						disc_name, ARCHIVE_NAME_SIZE - 1);
+				closedir(d);
+				return -1;
+			}
+
+			e = &entries[nEntries++];
+
+			strcpy(e->name, disc_name);
+			strcpy(e->path, path);
+			e->size = (uint32_t)st.st_size;
+		}
+	}
+
+	closedir(d);
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	char dir[MAX_PATH_LENGTH];
+	uint32_t sector;
+	uint32_t i;
+	FILE* out;
+
+	if(argc != 4)
+	{
+		fprintf(stderr, "Usage: %s <root dir> <data dir> <output file>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	snprintf(dir, sizeof(dir), "%s/%s", argv[1], argv[2]);
+
+	if(PackScanDir(dir, argv[2]) != 0)
+	{
+		return EXIT_FAILURE;
+	}
+
+	qsort(entries, nEntries, sizeof(TYPE_PACK_ENTRY), &PackCompareEntries);
+
+	// Data starts right after index.
+	sector = (ARCHIVE_HEADER_SIZE + (nEntries * ARCHIVE_ENTRY_SIZE) + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+	for(i = 0; i < nEntries; i++)
+	{
+		entries[i].sector = sector;
+		sector += (entries[i].size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	}
+
+	out = fopen(argv[3], "wb");
+
+	if(out == NULL)
+	{
+		fprintf(stderr, "Could not open \"%s\"!\n", argv[3]);
+		return EXIT_FAILURE;
+	}
+
+	PackWrite32(out, ARCHIVE_MAGIC);
+	PackWrite32(out, nEntries);
+
+	for(i = 0; i < nEntries; i++)
+	{
+		// Names are zero-padded, since entries table is static.
+		fwrite(entries[i].name, ARCHIVE_NAME_SIZE, 1, out);
+		PackWrite32(out, entries[i].sector);
+		PackWrite32(out, entries[i].size);
+	}
+
+	for(i = 0; i < nEntries; i++)
+	{
+		FILE* in = fopen(entries[i].path, "rb");
+		int ch;
+
+		PackPad(out);
+
+		if(in == NULL)
+		{
+			fprintf(stderr, "Could not open \"%s\"!\n", entries[i].path);
+			fclose(out);
+			return EXIT_FAILURE;
+		}
+
+		while( (ch = fgetc(in)) != EOF)
+		{
+			fputc(ch, out);
+		}
+
+		fclose(in);
+
+		printf("%-24s sector %4u, %7u bytes\n", entries[i].name, entries[i].sector, entries[i].size);
+	}
+
+	PackPad(out);
+
+	fclose(out);
+
+	return EXIT_SUCCESS;
+}
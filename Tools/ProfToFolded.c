@@ -0,0 +1,364 @@
+/* *************************************
+ * 	ProfToFolded: symbolizes PC samples taken by OpenSend resident
+ * 	profiler and writes them as folded stacks, as used by
+ * 	flamegraph.pl and compatible viewers (i.e.: speedscope).
+ *
+ * 	Usage: ProfToFolded <samples.bin> <program.elf> [output.folded]
+ * 	i.e.:
+ * 		ChannelDemux capture.bin 2 samples.bin
+ * 		ProfToFolded samples.bin GAME.elf | flamegraph.pl > prof.svg
+ *
+ * 	<samples.bin> holds CHANNEL_PROFILE payload: pairs of 32-bit
+ * 	little-endian words (interrupted PC, $ra). <program.elf> must be
+ * 	the unstripped ELF the uploaded PSX-EXE was made from.
+ *
+ * 	Each sample becomes a two-level stack "caller;function". Caller
+ * 	is taken from $ra, so it is only exact for leaf functions or
+ * 	right after a call. When $ra points into the same function, only
+ * 	that function is written.
+ * *************************************/
+
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+#define ELF_MAGIC 0x464C457F
+#define ELF_SHT_SYMTAB 2
+#define ELF_STT_FUNC 2
+#define ELF_SH_ENTRY_SIZE 40
+#define ELF_SYM_ENTRY_SIZE 16
+#define SAMPLE_SIZE 8
+// Symbol index used for addresses not found inside any function.
+#define SYMBOL_UNKNOWN -1
+
+/* *************************************
+ * 	Structs and enums
+ * *************************************/
+
+typedef struct t_Symbol
+{
+	uint32_t address;
+	uint32_t size;
+	const char* name;
+}TYPE_SYMBOL;
+
+typedef struct t_Stack
+{
+	long caller;
+	long function;
+	// Raw PC, so unknown addresses are not merged together.
+	uint32_t pc;
+}TYPE_STACK;
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+static TYPE_SYMBOL* symbols;
+static long nSymbols;
+
+static uint32_t ElfGet32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t ElfGet16(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint8_t* FileLoad(const char* path, size_t* size)
+{
+	uint8_t* data;
+	FILE* f = fopen(path, "rb");
+
+	if(f == NULL)
+	{
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	data = malloc(*size + 1);
+
+	if( (data != NULL) && (fread(data, 1, *size, f) != *size) )
+	{
+		free(data);
+		data = NULL;
+	}
+
+	fclose(f);
+
+	return data;
+}
+
+static int SymbolCompare(const void* a, const void* b)
+{
+	const TYPE_SYMBOL* sa = a;
+	const TYPE_SYMBOL* sb = b;
+
+	return (sa->address > sb->address) - (sa->address < sb->address);
+}
+
+/* *******************************************************************
+ *
+ * @name: static int ElfLoadSymbols(const uint8_t* elf, size_t size)
+ *
+ * @brief:
+ * 	Fills symbols[] with function symbols from ELF symbol table,
+ * 	sorted by address. Returns 0 if no symbol table was found.
+ *
+ * *******************************************************************/
+
+static int ElfLoadSymbols(const uint8_t* elf, size_t size)
+{
+	uint32_t shoff;
+	uint16_t shnum;
+	uint16_t i;
+
+	if( (size < 52) || (ElfGet32(elf) != ELF_MAGIC) )
+	{
+		return 0;
+	}
+
+	shoff = ElfGet32(&elf[32]);
+	shnum = ElfGet16(&elf[48]);
+
+	if((shoff + (shnum * ELF_SH_ENTRY_SIZE)) > size)
+	{
+		return 0;
+	}
+
+	for(i = 0; i < shnum; i++)
+	{
+		const uint8_t* sh = &elf[shoff + (i * ELF_SH_ENTRY_SIZE)];
+		const uint8_t* strsh;
+		uint32_t symoff;
+		uint32_t symsize;
+		uint32_t stroff;
+		uint32_t j;
+
+		if(ElfGet32(&sh[4]) != ELF_SHT_SYMTAB)
+		{
+			continue;
+		}
+
+		symoff = ElfGet32(&sh[16]);
+		symsize = ElfGet32(&sh[20]);
+		// sh_link: index of string table.
+		strsh = &elf[shoff + (ElfGet32(&sh[24]) * ELF_SH_ENTRY_SIZE)];
+		stroff = ElfGet32(&strsh[16]);
+
+		if((symoff + symsize) > size)
+		{
+			return 0;
+		}
+
+		symbols = malloc((symsize / ELF_SYM_ENTRY_SIZE) * sizeof(TYPE_SYMBOL));
+
+		if(symbols == NULL)
+		{
+			return 0;
+		}
+
+		for(j = 0; j < symsize; j += ELF_SYM_ENTRY_SIZE)
+		{
+			const uint8_t* sym = &elf[symoff + j];
+
+			if((sym[12] & 0xF) != ELF_STT_FUNC)
+			{
+				continue;
+			}
+
+			symbols[nSymbols].address = ElfGet32(&sym[4]);
+			symbols[nSymbols].size = ElfGet32(&sym[8]);
+			symbols[nSymbols].name = (const char*)&elf[stroff + ElfGet32(&sym[0])];
+			nSymbols++;
+		}
+
+		qsort(symbols, nSymbols, sizeof(TYPE_SYMBOL), SymbolCompare);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static long SymbolFind(uint32_t address)
+{
+	long lo = 0;
+	long hi = nSymbols - 1;
+	long found = SYMBOL_UNKNOWN;
+
+	// Last symbol starting at or before "address".
+	while(lo <= hi)
+	{
+		long mid = (lo + hi) / 2;
+
+		if(symbols[mid].address <= address)
+		{
+			found = mid;
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+
+	if(	(found != SYMBOL_UNKNOWN)
+			&&
+		(symbols[found].size != 0)
+			&&
+		(address >= (symbols[found].address + symbols[found].size))	)
+	{
+		found = SYMBOL_UNKNOWN;
+	}
+
+	return found;
+}
+
+static int StackCompare(const void* a, const void* b)
+{
+	const TYPE_STACK* sa = a;
+	const TYPE_STACK* sb = b;
+
+	if(sa->caller != sb->caller)
+	{
+		return (sa->caller > sb->caller) - (sa->caller < sb->caller);
+	}
+
+	if(sa->function != sb->function)
+	{
+		return (sa->function > sb->function) - (sa->function < sb->function);
+	}
+
+	if(sa->function == SYMBOL_UNKNOWN)
+	{
+		return (sa->pc > sb->pc) - (sa->pc < sb->pc);
+	}
+
+	return 0;
+}
+
+static void StackPrintFrame(FILE* f, long symbol, uint32_t address)
+{
+	if(symbol == SYMBOL_UNKNOWN)
+	{
+		fprintf(f, "0x%08X", address);
+	}
+	else
+	{
+		fprintf(f, "%s", symbols[symbol].name);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	TYPE_STACK* stacks;
+	uint8_t* samples;
+	uint8_t* elf;
+	size_t szSamples;
+	size_t szElf;
+	size_t nStacks;
+	size_t i;
+	FILE* out = stdout;
+
+	if( (argc != 3) && (argc != 4) )
+	{
+		fprintf(stderr, "Usage: %s <samples.bin> <program.elf> [output.folded]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	samples = FileLoad(argv[1], &szSamples);
+	elf = FileLoad(argv[2], &szElf);
+
+	if( (samples == NULL) || (elf == NULL) )
+	{
+		fprintf(stderr, "Could not read input files!\n");
+		return EXIT_FAILURE;
+	}
+
+	if(ElfLoadSymbols(elf, szElf) == 0)
+	{
+		fprintf(stderr, "No symbol table found on \"%s\"!\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	nStacks = szSamples / SAMPLE_SIZE;
+	stacks = malloc((nStacks + 1) * sizeof(TYPE_STACK));
+
+	if(stacks == NULL)
+	{
+		fprintf(stderr, "Out of memory!\n");
+		return EXIT_FAILURE;
+	}
+
+	for(i = 0; i < nStacks; i++)
+	{
+		uint32_t pc = ElfGet32(&samples[i * SAMPLE_SIZE]);
+		uint32_t ra = ElfGet32(&samples[(i * SAMPLE_SIZE) + 4]);
+
+		stacks[i].pc = pc;
+		stacks[i].function = SymbolFind(pc);
+		stacks[i].caller = SymbolFind(ra);
+
+		if(stacks[i].caller == stacks[i].function)
+		{
+			stacks[i].caller = SYMBOL_UNKNOWN;
+		}
+	}
+
+	qsort(stacks, nStacks, sizeof(TYPE_STACK), StackCompare);
+
+	if(argc == 4)
+	{
+		out = fopen(argv[3], "w");
+
+		if(out == NULL)
+		{
+			fprintf(stderr, "Could not create \"%s\"!\n", argv[3]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for(i = 0; i < nStacks; )
+	{
+		size_t count = 1;
+
+		while( ((i + count) < nStacks) && (StackCompare(&stacks[i], &stacks[i + count]) == 0) )
+		{
+			count++;
+		}
+
+		if(stacks[i].caller != SYMBOL_UNKNOWN)
+		{
+			fprintf(out, "%s;", symbols[stacks[i].caller].name);
+		}
+
+		StackPrintFrame(out, stacks[i].function, stacks[i].pc);
+		fprintf(out, " %lu\n", (unsigned long)count);
+
+		i += count;
+	}
+
+	if(out != stdout)
+	{
+		fclose(out);
+	}
+
+	fprintf(stderr, "%lu samples, %ld function symbols.\n", (unsigned long)nStacks, nSymbols);
+
+	return EXIT_SUCCESS;
+}
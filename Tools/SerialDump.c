@@ -0,0 +1,622 @@
+/* *************************************
+ * 	SerialDump: sends a dump command to OpenSend loader, while it
+ * 	waits for a PSX-EXE, and writes received data to a file.
+ *
+ * 	Usage:
+ * 		SerialDump <serial port> mem <address> <size> <output.bin>
+ * 		SerialDump <serial port> vram <x> <y> <w> <h> <output.raw>
+ * 		SerialDump <serial port> trace <output.bin>
+ * 	i.e.:
+ * 		SerialDump /dev/ttyUSB0 vram 0 0 0 0 screen.raw
+ * 		VramToPng screen.raw 384 240 screen.png
+ *
+ * 	*	mem: SERIAL_CMD_MEM_READ. Writes memory range, as is.
+ * 	*	vram: SERIAL_CMD_VRAM_CAPTURE. W = 0 captures displayed
+ * 		framebuffer. Captured rectangle is printed, so its size can
+ * 		be given to VramToPng.
+ * 	*	trace: SERIAL_CMD_TRACE_DUMP. Writes header and records, as
+ * 		read by TraceToJson.
+ *
+ * 	Data is received from CHANNEL_BULK (see Source/Channel.h) in
+ * 	blocks followed by their Adler-32 checksum. Each block is
+ * 	acknowledged, or requested again if it was not received right.
+ * 	Output file only holds the data itself.
+ * *************************************/
+
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+// Must match Source/Serial.h and Source/Serial.c.
+#define SERIAL_CMD_MEM_READ 'r'
+#define SERIAL_CMD_VRAM_CAPTURE 'v'
+#define SERIAL_CMD_TRACE_DUMP 'T'
+#define SERIAL_MEM_BLOCK_SIZE 256
+#define ACK_BYTE 'b'
+#define NACK_BYTE 'n'
+// Any other answer makes PSX abort transfer.
+#define ABORT_BYTE 'x'
+// Must match Source/Channel.h.
+#define CHANNEL_SYNC 0xA5
+#define CHANNEL_HEADER_SIZE 4
+#define CHANNEL_TRAILER_SIZE 2
+#define CHANNEL_MAX_PAYLOAD 64
+#define CHANNEL_FLETCHER_MOD 255
+#define CHANNEL_CONTROL 0
+#define CHANNEL_BULK 3
+#define CHANNEL_COUNT 4
+#define CHANNEL_MSG_DROPS 'd'
+#define CHANNEL_MSG_DROPS_SIZE 6
+
+#define TRACE_HEADER_SIZE 8
+#define TRACE_RECORD_SIZE 8
+#define VRAM_RECT_SIZE 8
+#define BLOCK_CHECKSUM_SIZE 4
+#define BLOCK_MAX_RETRIES 5
+#define SERIAL_REPLY_TIMEOUT_MS 2000
+// A block takes about 25 ms at 115200 bps.
+#define SERIAL_BLOCK_TIMEOUT_MS 500
+#define SERIAL_DRAIN_TIMEOUT_MS 100
+#define FIFO_SIZE 4096
+
+/* *************************************
+ * 	Structs and enums
+ * *************************************/
+
+typedef struct t_Fifo
+{
+	uint8_t data[FIFO_SIZE];
+	size_t used;
+	int sequence;
+	// Frames were lost since last ChannelFifoClear().
+	int lost;
+}TYPE_FIFO;
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+static uint8_t rx_frame[CHANNEL_HEADER_SIZE + CHANNEL_MAX_PAYLOAD + CHANNEL_TRAILER_SIZE];
+static size_t rx_frame_used;
+static TYPE_FIFO control = {.sequence = -1};
+static TYPE_FIFO bulk = {.sequence = -1};
+
+static uint32_t Get32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t Get16(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static void Put32(uint8_t* p, uint32_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+	p[2] = (uint8_t)(value >> 16);
+	p[3] = (uint8_t)(value >> 24);
+}
+
+static void Put16(uint8_t* p, uint16_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+static uint32_t Adler32(const uint8_t* data, size_t size)
+{
+	uint32_t a = 1;
+	uint32_t b = 0;
+	size_t i;
+
+	for(i = 0; i < size; i++)
+	{
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	return (b << 16) | a;
+}
+
+static int SerialOpen(const char* port)
+{
+	struct termios tty;
+	int fd = open(port, O_RDWR | O_NOCTTY);
+
+	if(fd < 0)
+	{
+		return -1;
+	}
+
+	if(tcgetattr(fd, &tty) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	cfmakeraw(&tty);
+	cfsetispeed(&tty, B115200);
+	cfsetospeed(&tty, B115200);
+	tty.c_cflag |= CLOCAL | CREAD;
+	tty.c_cc[VMIN] = 0;
+	tty.c_cc[VTIME] = 0;
+
+	if(tcsetattr(fd, TCSANOW, &tty) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	tcflush(fd, TCIOFLUSH);
+
+	return fd;
+}
+
+static int SerialWrite(int fd, const void* data, size_t size)
+{
+	const uint8_t* p = data;
+
+	while(size != 0)
+	{
+		ssize_t written = write(fd, p, size);
+
+		if(written <= 0)
+		{
+			return 0;
+		}
+
+		p += written;
+		size -= written;
+	}
+
+	return tcdrain(fd) == 0;
+}
+
+static int SerialWriteByte(int fd, uint8_t byte)
+{
+	return SerialWrite(fd, &byte, sizeof(byte));
+}
+
+static int ChannelIsValidFrame(const uint8_t* frame, size_t size)
+{
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+	size_t i;
+
+	for(i = 1; i < (size - CHANNEL_TRAILER_SIZE); i++)
+	{
+		sum1 = (sum1 + frame[i]) % CHANNEL_FLETCHER_MOD;
+		sum2 = (sum2 + sum1) % CHANNEL_FLETCHER_MOD;
+	}
+
+	return (frame[i] == sum1) && (frame[i + 1] == sum2);
+}
+
+static void ChannelFifoClear(TYPE_FIFO* fifo)
+{
+	fifo->used = 0;
+	fifo->lost = 0;
+}
+
+static void ChannelDispatch(const uint8_t* frame)
+{
+	TYPE_FIFO* fifo;
+	uint8_t len = frame[3];
+
+	if(frame[1] == CHANNEL_CONTROL)
+	{
+		fifo = &control;
+	}
+	else if(frame[1] == CHANNEL_BULK)
+	{
+		fifo = &bulk;
+	}
+	else
+	{
+		return;
+	}
+
+	if( (fifo->sequence >= 0) && (frame[2] != fifo->sequence) )
+	{
+		fifo->lost = 1;
+	}
+
+	fifo->sequence = (frame[2] + 1) & 0xFF;
+
+	if((fifo->used + len) <= sizeof(fifo->data))
+	{
+		memcpy(&fifo->data[fifo->used], &frame[CHANNEL_HEADER_SIZE], len);
+		fifo->used += len;
+	}
+	else
+	{
+		fifo->lost = 1;
+	}
+}
+
+// Looks for a complete frame on received bytes, resynchronizing on
+// next sync byte when received data is not a valid frame.
+static void ChannelReceiveByte(uint8_t byte)
+{
+	rx_frame[rx_frame_used++] = byte;
+
+	while(rx_frame_used != 0)
+	{
+		size_t frame_size;
+		size_t skip;
+
+		if(rx_frame[0] != CHANNEL_SYNC)
+		{
+			skip = 1;
+		}
+		else if(rx_frame_used < CHANNEL_HEADER_SIZE)
+		{
+			return;
+		}
+		else if( (rx_frame[3] == 0) || (rx_frame[3] > CHANNEL_MAX_PAYLOAD) || (rx_frame[1] >= CHANNEL_COUNT) )
+		{
+			skip = 1;
+		}
+		else
+		{
+			frame_size = CHANNEL_HEADER_SIZE + rx_frame[3] + CHANNEL_TRAILER_SIZE;
+
+			if(rx_frame_used < frame_size)
+			{
+				return;
+			}
+
+			if(ChannelIsValidFrame(rx_frame, frame_size))
+			{
+				ChannelDispatch(rx_frame);
+				skip = frame_size;
+			}
+			else
+			{
+				// Frame is lost. Its channel is unknown, so both are marked.
+				control.lost = 1;
+				bulk.lost = 1;
+				skip = 1;
+			}
+		}
+
+		rx_frame_used -= skip;
+		memmove(rx_frame, &rx_frame[skip], rx_frame_used);
+	}
+}
+
+// Waits up to "timeout_ms" for data and processes it. Returns 0 on timeout.
+static int ChannelReceive(int fd, int timeout_ms)
+{
+	uint8_t buffer[256];
+	struct timeval tv = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+	fd_set set;
+	ssize_t received;
+	ssize_t i;
+
+	FD_ZERO(&set);
+	FD_SET(fd, &set);
+
+	if(select(fd + 1, &set, NULL, NULL, &tv) <= 0)
+	{
+		return 0;
+	}
+
+	received = read(fd, buffer, sizeof(buffer));
+
+	if(received <= 0)
+	{
+		return 0;
+	}
+
+	for(i = 0; i < received; i++)
+	{
+		ChannelReceiveByte(buffer[i]);
+	}
+
+	return 1;
+}
+
+/* *******************************************************************
+ *
+ * @name: static int ChannelRead(int fd, TYPE_FIFO* fifo, uint8_t* dst, size_t n, int timeout_ms)
+ *
+ * @brief:
+ * 	Receives frames until "n" bytes from "fifo" channel are
+ * 	available, and moves them into "dst". Returns 0 on timeout.
+ *
+ * *******************************************************************/
+
+static int ChannelRead(int fd, TYPE_FIFO* fifo, uint8_t* dst, size_t n, int timeout_ms)
+{
+	while(fifo->used < n)
+	{
+		if(ChannelReceive(fd, timeout_ms) == 0)
+		{
+			return 0;
+		}
+	}
+
+	memcpy(dst, fifo->data, n);
+
+	fifo->used -= n;
+	memmove(fifo->data, &fifo->data[n], fifo->used);
+
+	return 1;
+}
+
+// Waits for ACK or NACK. Drop reports, which can be queued on control
+// channel before any reply, are skipped.
+static int ControlReadAnswer(int fd, uint8_t* answer)
+{
+	while(ChannelRead(fd, &control, answer, sizeof(uint8_t), SERIAL_REPLY_TIMEOUT_MS) != 0)
+	{
+		uint8_t report[CHANNEL_MSG_DROPS_SIZE - 1];
+
+		if(*answer != CHANNEL_MSG_DROPS)
+		{
+			return 1;
+		}
+
+		if(ChannelRead(fd, &control, report, sizeof(report), SERIAL_REPLY_TIMEOUT_MS) == 0)
+		{
+			return 0;
+		}
+
+		fprintf(stderr, "%u bytes dropped from channel %u.\n", Get32(&report[1]), report[0]);
+	}
+
+	return 0;
+}
+
+/* *******************************************************************
+ *
+ * @name: static int BulkReceive(int fd, FILE* out, uint32_t size)
+ *
+ * @brief:
+ * 	Receives "size" bytes sent by PSX in SERIAL_MEM_BLOCK_SIZE
+ * 	blocks (see SerialSendBlock(), Source/Serial.c) and writes them
+ * 	into "out", without checksums.
+ *
+ * @remarks:
+ * 	PSX waits for an answer once a whole block has been sent, so
+ * 	missing or corrupted data is discarded before asking for it
+ * 	again.
+ *
+ * *******************************************************************/
+
+static int BulkReceive(int fd, FILE* out, uint32_t size)
+{
+	uint8_t block[SERIAL_MEM_BLOCK_SIZE + BLOCK_CHECKSUM_SIZE];
+	uint32_t received = 0;
+
+	while(received < size)
+	{
+		uint32_t n = ((size - received) > SERIAL_MEM_BLOCK_SIZE)? SERIAL_MEM_BLOCK_SIZE : (size - received);
+		uint8_t retries;
+
+		for(retries = 0; retries < BLOCK_MAX_RETRIES; retries++)
+		{
+			int ok = ChannelRead(fd, &bulk, block, n + BLOCK_CHECKSUM_SIZE, SERIAL_BLOCK_TIMEOUT_MS);
+
+			if( (ok != 0) && (bulk.lost == 0) && (Adler32(block, n) == Get32(&block[n])) )
+			{
+				break;
+			}
+
+			// Rest of a partially received block is dropped too.
+			while(ChannelReceive(fd, SERIAL_DRAIN_TIMEOUT_MS) != 0);
+
+			ChannelFifoClear(&bulk);
+
+			if(SerialWriteByte(fd, NACK_BYTE) == 0)
+			{
+				return 0;
+			}
+		}
+
+		if(retries == BLOCK_MAX_RETRIES)
+		{
+			fprintf(stderr, "Block at offset %u could not be received!\n", received);
+			SerialWriteByte(fd, ABORT_BYTE);
+			return 0;
+		}
+
+		if(fwrite(block, 1, n, out) != n)
+		{
+			fprintf(stderr, "Could not write output file!\n");
+			SerialWriteByte(fd, ABORT_BYTE);
+			return 0;
+		}
+
+		received += n;
+
+		if(SerialWriteByte(fd, ACK_BYTE) == 0)
+		{
+			return 0;
+		}
+
+		fprintf(stderr, "\r%u/%u bytes", received, size);
+	}
+
+	fprintf(stderr, "\n");
+
+	return 1;
+}
+
+static int DumpMemory(int fd, FILE* out, uint32_t address, uint32_t size)
+{
+	uint8_t command[1 + (2 * sizeof(uint32_t))] = {SERIAL_CMD_MEM_READ};
+	uint8_t answer;
+
+	Put32(&command[1], address);
+	Put32(&command[5], size);
+
+	if( (SerialWrite(fd, command, sizeof(command)) == 0) || (ControlReadAnswer(fd, &answer) == 0) )
+	{
+		fprintf(stderr, "PSX did not answer. Is OpenSend waiting for a PSX-EXE?\n");
+		return 0;
+	}
+	else if(answer != ACK_BYTE)
+	{
+		fprintf(stderr, "PSX rejected range 0x%08X, %u bytes.\n", address, size);
+		return 0;
+	}
+
+	return BulkReceive(fd, out, size);
+}
+
+static int DumpVRAM(int fd, FILE* out, const uint16_t rect[4])
+{
+	uint8_t command[1 + VRAM_RECT_SIZE] = {SERIAL_CMD_VRAM_CAPTURE};
+	uint8_t captured[VRAM_RECT_SIZE];
+	uint8_t answer;
+	uint8_t i;
+
+	for(i = 0; i < 4; i++)
+	{
+		Put16(&command[1 + (i * sizeof(uint16_t))], rect[i]);
+	}
+
+	if( (SerialWrite(fd, command, sizeof(command)) == 0) || (ControlReadAnswer(fd, &answer) == 0) )
+	{
+		fprintf(stderr, "PSX did not answer. Is OpenSend waiting for a PSX-EXE?\n");
+		return 0;
+	}
+	else if(answer != ACK_BYTE)
+	{
+		fprintf(stderr, "PSX rejected rectangle.\n");
+		return 0;
+	}
+
+	if(ChannelRead(fd, &control, captured, sizeof(captured), SERIAL_REPLY_TIMEOUT_MS) == 0)
+	{
+		fprintf(stderr, "Captured rectangle not received!\n");
+		return 0;
+	}
+
+	printf("Captured %ux%u rectangle at (%u, %u).\n",
+			Get16(&captured[4]), Get16(&captured[6]), Get16(&captured[0]), Get16(&captured[2]));
+
+	return BulkReceive(fd, out, (uint32_t)Get16(&captured[4]) * Get16(&captured[6]) * sizeof(uint16_t));
+}
+
+static int DumpTrace(int fd, FILE* out)
+{
+	uint8_t command = SERIAL_CMD_TRACE_DUMP;
+	uint8_t header[TRACE_HEADER_SIZE];
+	uint32_t nRecords;
+
+	if(	(SerialWrite(fd, &command, sizeof(command)) == 0)
+				||
+		(ChannelRead(fd, &bulk, header, sizeof(header), SERIAL_REPLY_TIMEOUT_MS) == 0)	)
+	{
+		fprintf(stderr, "PSX did not answer. Is OpenSend waiting for a PSX-EXE?\n");
+		return 0;
+	}
+
+	nRecords = Get32(&header[0]);
+
+	printf("%u trace records.\n", nRecords);
+
+	if(fwrite(header, sizeof(header), 1, out) != 1)
+	{
+		fprintf(stderr, "Could not write output file!\n");
+		return 0;
+	}
+
+	return BulkReceive(fd, out, nRecords * TRACE_RECORD_SIZE);
+}
+
+int main(int argc, char* argv[])
+{
+	const char* command = (argc > 2)? argv[2] : "";
+	const char* output;
+	FILE* out;
+	int result;
+	int fd;
+
+	if( (strcmp(command, "mem") == 0) && (argc == 6) )
+	{
+		output = argv[5];
+	}
+	else if( (strcmp(command, "vram") == 0) && (argc == 8) )
+	{
+		output = argv[7];
+	}
+	else if( (strcmp(command, "trace") == 0) && (argc == 4) )
+	{
+		output = argv[3];
+	}
+	else
+	{
+		fprintf(stderr,	"Usage:\n"
+						"\t%s <serial port> mem <address> <size> <output.bin>\n"
+						"\t%s <serial port> vram <x> <y> <w> <h> <output.raw>\n"
+						"\t%s <serial port> trace <output.bin>\n",
+						argv[0], argv[0], argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fd = SerialOpen(argv[1]);
+
+	if(fd < 0)
+	{
+		fprintf(stderr, "Could not open \"%s\"!\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	out = fopen(output, "wb");
+
+	if(out == NULL)
+	{
+		fprintf(stderr, "Could not create \"%s\"!\n", output);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	// Anything sent before the command is not part of the reply.
+	while(ChannelReceive(fd, SERIAL_DRAIN_TIMEOUT_MS) != 0);
+
+	ChannelFifoClear(&control);
+	ChannelFifoClear(&bulk);
+
+	if(strcmp(command, "mem") == 0)
+	{
+		result = DumpMemory(fd, out, strtoul(argv[3], NULL, 0), strtoul(argv[4], NULL, 0));
+	}
+	else if(strcmp(command, "vram") == 0)
+	{
+		const uint16_t rect[4] =
+		{
+			strtoul(argv[3], NULL, 0), strtoul(argv[4], NULL, 0),
+			strtoul(argv[5], NULL, 0), strtoul(argv[6], NULL, 0)
+		};
+
+		result = DumpVRAM(fd, out, rect);
+	}
+	else
+	{
+		result = DumpTrace(fd, out);
+	}
+
+	fclose(out);
+	close(fd);
+
+	return (result != 0)? EXIT_SUCCESS : EXIT_FAILURE;
+}
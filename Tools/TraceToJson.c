@@ -0,0 +1,267 @@
+/* *************************************
+ * 	TraceToJson: converts an OpenSend event trace into Chrome trace
+ * 	event JSON, which can be opened with chrome://tracing or
+ * 	ui.perfetto.dev.
+ *
+ * 	Usage: TraceToJson <trace.bin> [output.json]
+ *
+ * 	Input is the data received from SERIAL_CMD_TRACE_DUMP, as
+ * 	written by SerialDump (little-endian):
+ * 		uint32_t number of records
+ * 		uint32_t timestamp frequency (Hz)
+ * 		Records, oldest first (see TYPE_TRACE_RECORD, Source/Trace.h):
+ * 			uint8_t event, uint8_t phase, uint16_t time, uint32_t arg
+ *
+ * 	Timestamps are only 16 bits long, so they are extended here
+ * 	assuming consecutive records are less than 65536 ticks apart.
+ * 	Each kind of event is shown on its own track.
+ * *************************************/
+
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+#define TRACE_HEADER_SIZE 8
+#define TRACE_RECORD_SIZE 8
+#define TRACE_PHASE_BEGIN 'B'
+#define TRACE_PHASE_END 'E'
+#define TRACE_PHASE_INSTANT 'i'
+#define TRACE_PID 1
+
+/* *************************************
+ * 	Structs and enums
+ * *************************************/
+
+// Must match TRACE_EVENT (Source/Trace.h).
+enum
+{
+	TRACE_EVENT_SERIAL_STATE = 0,
+	TRACE_EVENT_VBLANK_ISR,
+	TRACE_EVENT_GFX_DRAW,
+	TRACE_EVENT_GPU_LIST,
+	TRACE_EVENT_CD_LOAD,
+
+	TRACE_EVENT_COUNT
+};
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+static const char* const event_names[TRACE_EVENT_COUNT] =
+{
+	[TRACE_EVENT_SERIAL_STATE] = "Serial state",
+	[TRACE_EVENT_VBLANK_ISR] = "ISR_Serial",
+	[TRACE_EVENT_GFX_DRAW] = "GfxDrawScene_Fast",
+	[TRACE_EVENT_GPU_LIST] = "Primitive list",
+	[TRACE_EVENT_CD_LOAD] = "SystemLoadFileToBuffer"
+};
+
+static const char* const track_names[TRACE_EVENT_COUNT] =
+{
+	[TRACE_EVENT_SERIAL_STATE] = "Serial protocol",
+	[TRACE_EVENT_VBLANK_ISR] = "VBlank ISR",
+	[TRACE_EVENT_GFX_DRAW] = "CPU drawing",
+	[TRACE_EVENT_GPU_LIST] = "GPU",
+	[TRACE_EVENT_CD_LOAD] = "CD-ROM"
+};
+
+// Must match SERIAL_STATE (Source/Serial.h).
+static const char* const serial_state_names[] =
+{
+	"INIT",
+	"STANDBY",
+	"WRITING_ACK",
+	"READING_HEADER",
+	"READING_EXE_SIZE",
+	"READING_EXE_DATA",
+	"WAITING_USER_INPUT",
+	"CLEANING_MEMORY",
+	"SERVING_COMMAND"
+};
+
+// Open slices on each track, so unmatched records can be fixed.
+static unsigned int depth[TRACE_EVENT_COUNT];
+static int first_event = 1;
+
+static uint32_t TraceGet32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void TraceWriteEvent(FILE* f, const char* name, char phase, double ts, unsigned int track, uint32_t arg)
+{
+	fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.1f,\"pid\":%d,\"tid\":%u",
+			first_event? "" : ",", name, phase, ts, TRACE_PID, track + 1);
+
+	if(phase == TRACE_PHASE_INSTANT)
+	{
+		fprintf(f, ",\"s\":\"t\"");
+	}
+
+	fprintf(f, ",\"args\":{\"arg\":%lu}}", (unsigned long)arg);
+
+	first_event = 0;
+}
+
+int main(int argc, char* argv[])
+{
+	uint8_t header[TRACE_HEADER_SIZE];
+	uint32_t nRecords;
+	uint32_t frequency;
+	uint32_t i;
+	uint64_t ticks = 0;
+	uint16_t last_time = 0;
+	double ts = 0.0;
+	FILE* in;
+	FILE* out = stdout;
+
+	if( (argc != 2) && (argc != 3) )
+	{
+		fprintf(stderr, "Usage: %s <trace.bin> [output.json]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	in = fopen(argv[1], "rb");
+
+	if( (in == NULL) || (fread(header, sizeof(header), 1, in) != 1) )
+	{
+		fprintf(stderr, "Could not read \"%s\"!\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	nRecords = TraceGet32(&header[0]);
+	frequency = TraceGet32(&header[4]);
+
+	if(frequency == 0)
+	{
+		fprintf(stderr, "Invalid timestamp frequency!\n");
+		return EXIT_FAILURE;
+	}
+
+	if(argc == 3)
+	{
+		out = fopen(argv[2], "w");
+
+		if(out == NULL)
+		{
+			fprintf(stderr, "Could not create \"%s\"!\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	for(i = 0; i < TRACE_EVENT_COUNT; i++)
+	{
+		fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+				first_event? "" : ",", TRACE_PID, i + 1, track_names[i]);
+
+		first_event = 0;
+	}
+
+	for(i = 0; i < nRecords; i++)
+	{
+		uint8_t record[TRACE_RECORD_SIZE];
+		uint8_t event;
+		uint8_t phase;
+		uint16_t time;
+		uint32_t arg;
+
+		if(fread(record, sizeof(record), 1, in) != 1)
+		{
+			fprintf(stderr, "Trace truncated after %lu records.\n", (unsigned long)i);
+			break;
+		}
+
+		event = record[0];
+		phase = record[1];
+		time = record[2] | (record[3] << 8);
+		arg = TraceGet32(&record[4]);
+
+		if(i != 0)
+		{
+			ticks += (uint16_t)(time - last_time);
+		}
+
+		last_time = time;
+		ts = (ticks * 1000000.0) / frequency;
+
+		if(event >= TRACE_EVENT_COUNT)
+		{
+			fprintf(stderr, "Unknown event %u, skipped.\n", event);
+			continue;
+		}
+
+		if(event == TRACE_EVENT_SERIAL_STATE)
+		{
+			// Each state is shown as a slice lasting until next one.
+			const char* name = (arg < (sizeof(serial_state_names) / sizeof(serial_state_names[0])))?
+								serial_state_names[arg] : "UNKNOWN";
+
+			if(depth[event] != 0)
+			{
+				TraceWriteEvent(out, "", TRACE_PHASE_END, ts, event, arg);
+			}
+
+			TraceWriteEvent(out, name, TRACE_PHASE_BEGIN, ts, event, arg);
+			depth[event] = 1;
+			continue;
+		}
+
+		switch(phase)
+		{
+			case TRACE_PHASE_BEGIN:
+				depth[event]++;
+			break;
+
+			case TRACE_PHASE_END:
+				if(depth[event] == 0)
+				{
+					// Begin was overwritten on PSX ring.
+					continue;
+				}
+
+				depth[event]--;
+			break;
+
+			case TRACE_PHASE_INSTANT:
+			break;
+
+			default:
+				fprintf(stderr, "Unknown phase 0x%02X, skipped.\n", phase);
+			continue;
+		}
+
+		TraceWriteEvent(out, event_names[event], (char)phase, ts, event, arg);
+	}
+
+	// Slices still open when trace was dumped.
+	for(i = 0; i < TRACE_EVENT_COUNT; i++)
+	{
+		while(depth[i] != 0)
+		{
+			TraceWriteEvent(out, event_names[i], TRACE_PHASE_END, ts, i, 0);
+			depth[i]--;
+		}
+	}
+
+	fprintf(out, "\n]}\n");
+
+	if(out != stdout)
+	{
+		fclose(out);
+	}
+
+	fclose(in);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+/* *************************************
+ * 	VramToPng: converts a VRAM capture into a PNG image.
+ *
+ * 	Usage: VramToPng <input.raw> <width> <height> <output.png>
+ *
+ * 	Input is the pixel data received from SERIAL_CMD_VRAM_CAPTURE,
+ * 	as written by SerialDump: 16-bit little-endian pixels, row by
+ * 	row, with red on bits 0-4, green on bits 5-9 and blue on bits
+ * 	10-14.
+ *
+ * 	PNG data is stored without compression, so no external library
+ * 	is needed.
+ * *************************************/
+
+/* *************************************
+ * 	Includes
+ * *************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/* *************************************
+ * 	Defines
+ * *************************************/
+
+#define VRAM_W 1024
+#define VRAM_H 512
+// Maximum length of a stored (uncompressed) deflate block.
+#define DEFLATE_MAX_STORED 0xFFFF
+#define ADLER32_MOD 65521
+
+/* *************************************
+ * 	Local Variables
+ * *************************************/
+
+static uint32_t crc_table[256];
+
+static void PngInitCrc(void)
+{
+	uint32_t n;
+
+	for(n = 0; n < 256; n++)
+	{
+		uint32_t c = n;
+		int k;
+
+		for(k = 0; k < 8; k++)
+		{
+			c = (c & 1)? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+		}
+
+		crc_table[n] = c;
+	}
+}
+
+static uint32_t PngCrc(uint32_t crc, const uint8_t* data, size_t size)
+{
+	while(size--)
+	{
+		crc = crc_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+	}
+
+	return crc;
+}
+
+static void PngPut32(uint8_t* dst, uint32_t value)
+{
+	dst[0] = (uint8_t)(value >> 24);
+	dst[1] = (uint8_t)(value >> 16);
+	dst[2] = (uint8_t)(value >> 8);
+	dst[3] = (uint8_t)value;
+}
+
+static void PngWriteChunk(FILE* f, const char* type, const uint8_t* data, uint32_t size)
+{
+	uint8_t header[8];
+	uint8_t crc[4];
+	uint32_t value;
+
+	PngPut32(header, size);
+	memcpy(&header[4], type, 4);
+
+	value = PngCrc(0xFFFFFFFF, &header[4], 4);
+	value = PngCrc(value, data, size) ^ 0xFFFFFFFF;
+	PngPut32(crc, value);
+
+	fwrite(header, sizeof(header), 1, f);
+	fwrite(data, 1, size, f);
+	fwrite(crc, sizeof(crc), 1, f);
+}
+
+int main(int argc, char* argv[])
+{
+	static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	uint8_t ihdr[13];
+	uint8_t* raw;
+	uint8_t* pixels;
+	uint8_t* zdata;
+	size_t szRaw;
+	size_t szZdata = 0;
+	size_t offset;
+	uint32_t a = 1;
+	uint32_t b = 0;
+	long w;
+	long h;
+	long x;
+	long y;
+	FILE* f;
+
+	if(argc != 5)
+	{
+		fprintf(stderr, "Usage: %s <input.raw> <width> <height> <output.png>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	w = strtol(argv[2], NULL, 0);
+	h = strtol(argv[3], NULL, 0);
+
+	if( (w <= 0) || (w > VRAM_W) || (h <= 0) || (h > VRAM_H) )
+	{
+		fprintf(stderr, "Invalid size %ldx%ld!\n", w, h);
+		return EXIT_FAILURE;
+	}
+
+	pixels = malloc(w * h * 2);
+	// Each row starts with filter type byte.
+	szRaw = (size_t)h * ((w * 3) + 1);
+	raw = malloc(szRaw);
+	zdata = malloc(szRaw + ((szRaw / DEFLATE_MAX_STORED) + 1) * 5 + 6);
+
+	if( (pixels == NULL) || (raw == NULL) || (zdata == NULL) )
+	{
+		fprintf(stderr, "Out of memory!\n");
+		return EXIT_FAILURE;
+	}
+
+	f = fopen(argv[1], "rb");
+
+	if( (f == NULL) || (fread(pixels, 2, w * h, f) != (size_t)(w * h)) )
+	{
+		fprintf(stderr, "Could not read %ld pixels from \"%s\"!\n", w * h, argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	fclose(f);
+
+	for(y = 0, offset = 0; y < h; y++)
+	{
+		raw[offset++] = 0;
+
+		for(x = 0; x < w; x++)
+		{
+			const uint8_t* p = &pixels[((y * w) + x) * 2];
+			uint16_t pixel = p[0] | (p[1] << 8);
+
+			raw[offset++] = ((pixel & 0x1F) << 3) | ((pixel & 0x1F) >> 2);
+			raw[offset++] = (((pixel >> 5) & 0x1F) << 3) | (((pixel >> 5) & 0x1F) >> 2);
+			raw[offset++] = (((pixel >> 10) & 0x1F) << 3) | (((pixel >> 10) & 0x1F) >> 2);
+		}
+	}
+
+	// zlib header, stored deflate blocks and Adler-32.
+	zdata[szZdata++] = 0x78;
+	zdata[szZdata++] = 0x01;
+
+	for(offset = 0; offset < szRaw; )
+	{
+		size_t block = szRaw - offset;
+		size_t i;
+
+		if(block > DEFLATE_MAX_STORED)
+		{
+			block = DEFLATE_MAX_STORED;
+		}
+
+		zdata[szZdata++] = ((offset + block) == szRaw)? 1 : 0;
+		zdata[szZdata++] = (uint8_t)block;
+		zdata[szZdata++] = (uint8_t)(block >> 8);
+		zdata[szZdata++] = (uint8_t)~block;
+		zdata[szZdata++] = (uint8_t)(~block >> 8);
+
+		memcpy(&zdata[szZdata], &raw[offset], block);
+		szZdata += block;
+
+		for(i = 0; i < block; i++)
+		{
+			a = (a + raw[offset + i]) % ADLER32_MOD;
+			b = (b + a) % ADLER32_MOD;
+		}
+
+		offset += block;
+	}
+
+	PngPut32(&zdata[szZdata], (b << 16) | a);
+	szZdata += 4;
+
+	PngPut32(&ihdr[0], (uint32_t)w);
+	PngPut32(&ihdr[4], (uint32_t)h);
+	ihdr[8] = 8;	// Bit depth
+	ihdr[9] = 2;	// Truecolor
+	ihdr[10] = 0;	// Deflate
+	ihdr[11] = 0;	// Adaptive filtering
+	ihdr[12] = 0;	// No interlace
+
+	f = fopen(argv[4], "wb");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, "Could not open \"%s\"!\n", argv[4]);
+		return EXIT_FAILURE;
+	}
+
+	PngInitCrc();
+
+	fwrite(signature, sizeof(signature), 1, f);
+	PngWriteChunk(f, "IHDR", ihdr, sizeof(ihdr));
+	PngWriteChunk(f, "IDAT", zdata, (uint32_t)szZdata);
+	PngWriteChunk(f, "IEND", NULL, 0);
+
+	fclose(f);
+
+	free(pixels);
+	free(raw);
+	free(zdata);
+
+	return EXIT_SUCCESS;
+}